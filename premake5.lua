@@ -29,6 +29,7 @@ project "graphics-project"
   files { "%{wks.location}/**.cpp", "%{wks.location}/**.hpp" }
   files { "%{wks.location}/**.c"  , "%{wks.location}/**.h"   }
   removefiles { "%{wks.location}/source/window/platform/*" }
+  removefiles { "%{wks.location}/tools/*" }
   includedirs { "%{wks.location}/source", "%{wks.location}/extern"}
 
   filter "system:windows"
@@ -44,6 +45,92 @@ project "graphics-project"
 
   filter "system:linux"
     defines "PLATFORM_X11"
-    links { "X11", "GLX", "dl" }
+    links { "X11", "GLX", "dl", "pthread" }
 
   filter {}
+
+project "png-bench"
+  kind "ConsoleApp"
+  language "C++"
+  cppdialect "C++17"
+
+  location "%{wks.location}/build"
+  targetdir "%{prj.location}/%{cfg.buildcfg}"
+  objdir "%{prj.location}/%{cfg.buildcfg}/obj/png-bench"
+
+  warnings "Extra"
+
+  files {
+    "%{wks.location}/tools/pngBench.cpp",
+    "%{wks.location}/source/utility/png.cpp",
+    "%{wks.location}/source/utility/common.cpp",
+    "%{wks.location}/source/utility/cpu.cpp",
+  }
+  includedirs { "%{wks.location}/source", "%{wks.location}/extern"}
+
+project "chunk-check"
+  kind "ConsoleApp"
+  language "C++"
+  cppdialect "C++17"
+
+  location "%{wks.location}/build"
+  targetdir "%{prj.location}/%{cfg.buildcfg}"
+  objdir "%{prj.location}/%{cfg.buildcfg}/obj/chunk-check"
+
+  warnings "Extra"
+
+  files {
+    "%{wks.location}/tools/chunkCheck.cpp",
+    "%{wks.location}/source/world/chunk.cpp",
+    "%{wks.location}/source/world/block.cpp",
+    "%{wks.location}/source/world/blockStorage.cpp",
+    "%{wks.location}/source/utility/noise.cpp",
+    "%{wks.location}/source/utility/common.cpp",
+    "%{wks.location}/source/utility/cpu.cpp",
+    "%{wks.location}/source/rendering/bufferArena.cpp",
+    "%{wks.location}/source/rendering/vertexArray.cpp",
+    "%{wks.location}/extern/glad/glad.c",
+  }
+  includedirs { "%{wks.location}/source", "%{wks.location}/extern"}
+
+  filter "system:linux"
+    links { "dl", "pthread" }
+
+  filter {}
+
+project "block-check"
+  kind "ConsoleApp"
+  language "C++"
+  cppdialect "C++17"
+
+  location "%{wks.location}/build"
+  targetdir "%{prj.location}/%{cfg.buildcfg}"
+  objdir "%{prj.location}/%{cfg.buildcfg}/obj/block-check"
+
+  warnings "Extra"
+
+  files {
+    "%{wks.location}/tools/blockCheck.cpp",
+    "%{wks.location}/source/world/blockStorage.cpp",
+    "%{wks.location}/source/utility/common.cpp",
+  }
+  includedirs { "%{wks.location}/source", "%{wks.location}/extern"}
+
+project "png-check"
+  kind "ConsoleApp"
+  language "C++"
+  cppdialect "C++17"
+
+  location "%{wks.location}/build"
+  targetdir "%{prj.location}/%{cfg.buildcfg}"
+  objdir "%{prj.location}/%{cfg.buildcfg}/obj/png-check"
+
+  warnings "Extra"
+
+  files {
+    "%{wks.location}/tools/pngCheck.cpp",
+    "%{wks.location}/source/utility/png.cpp",
+    "%{wks.location}/source/utility/common.cpp",
+    "%{wks.location}/source/utility/cpu.cpp",
+  }
+  includedirs { "%{wks.location}/source", "%{wks.location}/extern"}
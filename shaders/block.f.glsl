@@ -4,49 +4,46 @@ out vec4 frg;
 in vec3 normal;
 in vec3 texCoord;
 in vec3 viewDir;
-in vec4 lsPos;
+in vec3 worldPos;
+in float viewDepth;
 in float aoFactor;
 in float projZ;
 
-struct Settings {
-    bool doEnvMap;
-    bool doLighting;
-    bool doShadow;
-    bool doAO;
-    bool doFog;
-};
-
-uniform Settings settings;
+// DO_ENV_MAP, DO_LIGHTING, DO_SHADOW, DO_AO and DO_FOG are defined in front
+// of the source for the variant of the program being built
 
 uniform sampler2DArray texArray;
 uniform sampler2D shadowMap;
 uniform samplerCube skybox;
 
-struct DirectionalLight {
-    vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-};
-
 const float ZFAR = 1000000.0;
 const float FCOEF = 2.0 / log2(ZFAR + 1.0);
 const float HALF_FCOEF = 0.5 * FCOEF;
 
-uniform DirectionalLight sun;
-
+// the first cascade that reaches as far as the fragment and covers it, a
+// cascade that has not caught up with the camera yet leaves it to the next
 float getShadow(float d) {
-    vec3 lproj = lsPos.xyz / lsPos.w;
-    lproj = lproj * 0.5f + 0.5f;
-    if (lproj.z > 1 || d <= 0) return 1.0f;
+    if (d <= 0) return 1.0f;
 
-    float depth = texture(shadowMap, lproj.xy).r;
-    return (lproj.z - 0.00125f > depth ? 0.0f : 1.0f);
+    for (int i = 0; i < cascadeCount; i ++) {
+        if (viewDepth > cascadeSplits[i]) continue;
+
+        vec4 lsPos = cascadeViewProj[i] * vec4(worldPos, 1.0f);
+        vec3 lproj = lsPos.xyz / lsPos.w;
+        lproj = lproj * 0.5f + 0.5f;
+        if (any(lessThan(lproj.xy, vec2(0))) || any(greaterThan(lproj.xy, vec2(1)))) continue;
+        if (lproj.z > 1) return 1.0f;
+
+        float depth = texture(shadowMap, cascadeRects[i].xy + lproj.xy * cascadeRects[i].zw).r;
+        return (lproj.z - cascadeBias[i] > depth ? 0.0f : 1.0f);
+    }
+    return 1.0f;
 }
 
 vec3 applyFog(vec3 rgb)
 {
     const float fogDensity = 0.00002f;
-    float sunAmount = max(-dot(viewDir, sun.direction), 0.0) * mix(1.0f, 0.0f, min(abs(sun.direction.y) / 0.6f, 1.0f));
+    float sunAmount = max(-dot(viewDir, sunDirection), 0.0) * mix(1.0f, 0.0f, min(abs(sunDirection.y) / 0.6f, 1.0f));
     vec3  fogColor  = mix(vec3(0.5f, 0.6f, 0.8f), vec3(1.1f, 1.0f, 0.7f), sunAmount * sunAmount);
     float fogAmount = 1 - clamp(exp(-fogDensity * projZ * projZ), 0, 1);
     return mix(rgb, fogColor, fogAmount);
@@ -55,37 +52,46 @@ vec3 applyFog(vec3 rgb)
 vec3 calcLight()
 {
     float ambientStrength = 0.4f;
-    vec3 ambient = ambientStrength * sun.ambient;
+    vec3 ambient = ambientStrength * sunAmbient;
 
-    float dotp = dot(normal, sun.direction);
+    float dotp = dot(normal, sunDirection);
     float diff = max(-dotp, 0.0f);
-    vec3 diffuse = diff * sun.diffuse;
+    vec3 diffuse = diff * sunDiffuse;
 
     float isWater = float(texCoord.z == 6);
 
     float shininess = 16.0f + 112.0f * isWater;
     float specularStrength = 0.4f + 0.6f * isWater;
-    vec3 reflectDir = reflect(-sun.direction, normal);
+    vec3 reflectDir = reflect(-sunDirection, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-    vec3 specular = specularStrength * spec * sun.diffuse;
+    vec3 specular = specularStrength * spec * sunDiffuse;
 
-    float shadow = settings.doShadow ? getShadow(diff) : 1;
+#ifdef DO_SHADOW
+    float shadow = getShadow(diff);
+#else
+    float shadow = 1;
+#endif
     return (ambient + shadow * (diffuse + specular));
 }
 
 void main() {
     vec4 tex = texture(texArray, texCoord);
-    vec3 alb = tex.rgb;
-    vec3 lit = calcLight();
+    vec3 clr = tex.rgb;
 
-    vec3 clr = alb;
+#ifdef DO_ENV_MAP
     vec3 R = reflect(viewDir, normal);
     float F = (0.5f * float(texCoord.z == 6));
-
-    if (settings.doEnvMap  ) clr = mix(clr, texture(skybox, R).rgb, F);
-    if (settings.doLighting) clr = clr * lit;
-    if (settings.doAO      ) clr = clr * aoFactor;
-    if (settings.doFog     ) clr = applyFog(clr);
+    clr = mix(clr, texture(skybox, R).rgb, F);
+#endif
+#ifdef DO_LIGHTING
+    clr = clr * calcLight();
+#endif
+#ifdef DO_AO
+    clr = clr * aoFactor;
+#endif
+#ifdef DO_FOG
+    clr = applyFog(clr);
+#endif
 
     frg = vec4(clr, tex.a);
 }
@@ -1,59 +1,87 @@
 #version 330 core
-layout (location = 0) in uint aVert;
 
-uniform vec2 xz;
-uniform vec3 camPos;
-uniform mat4 camViewProj;
-uniform mat4 sunViewProj;
+// one record per face, see fillQuad in world/block.hpp
+uniform usamplerBuffer records;
+uniform samplerBuffer chunkOrigins;
 
 #define ONES(n) ((1u << n) - 1u)
 
+// records in a page of the chunk buffer, every page belongs to a single
+// chunk and holds its origin in chunkOrigins
+#define PAGE_RECORDS 128
+
+// the normal of each FaceDir, the rest of the quad is in faces.glsl
+const vec3 faceNormals[6] = vec3[6](
+    vec3(0, 0, -1), vec3(0, 0, 1),
+    vec3(1, 0,  0), vec3(-1, 0, 0),
+    vec3(0, 1,  0), vec3(0, -1, 0)
+);
+
+// the quad indices split a quad between corners 0 and 3, the corners are
+// walked in this order instead to split it between 1 and 2
+const uint flipped[4] = uint[4](1u, 3u, 0u, 2u);
+
 out vec3 normal;
 out vec3 texCoord;
-out vec4 lsPos;
+out vec3 worldPos;
+out float viewDepth;
 out vec3 viewDir;
 out float aoFactor;
 out float projZ;
 
 float aoArr[4] = float[4](0.25f, 0.5f, 0.75f, 1.0f);
 
-vec3 norms[3] = vec3[3](
-    vec3(1.0f, 0.0f, 0.0f),
-    vec3(0.0f, 1.0f, 0.0f),
-    vec3(0.0f, 0.0f, 1.0f)
-);
-
 const float ZFAR = 1000000.0;
 const float FCOEF = 4.0 / log2(ZFAR + 1.0);
 
 void main() {
-    uint v = aVert;
+    int record = gl_VertexID / 4;
+    uint corner = uint(gl_VertexID) & 3u;
+    uvec2 r = texelFetch(records, record).xy;
 
-    float x = float(v & ONES(4));
+    uint v = r.x;
+    vec3 p;
+    p.x = float(v & ONES(4));
     v = v >> 4;
-    float z = float(v & ONES(4));
+    p.z = float(v & ONES(4));
     v = v >> 4;
-    float y = float(v & ONES(8));
+    p.y = float(v & ONES(8));
     v = v >> 8;
-    uint n  = v & ONES(2);
-    v = v >> 2;
-    uint s  = v & ONES(1);
-    v = v >> 1;
-    uint uv = v & ONES(2);
-    v = v >> 2;
-    uint ao = v & ONES(2);
-    v = v >> 2;
-    uint w  = v & ONES(8);
-
-    aoFactor = aoArr[ao];
-    normal = norms[n] * (1.0f - float(s) * 2.0f);
-    texCoord = vec3(float((uv >> 1u) & 1u), float(uv & 1u), float(w));
-
-    vec3 pos = vec3(x + xz.x, y, z + xz.y);
+    uint d  = v & ONES(3);
+    v = v >> 3;
+    float w = float(v & ONES(5));
+    v = v >> 5;
+    float h = float(v & ONES(5));
+
+    uint ao = r.y & ONES(8);
+    uint layer = (r.y >> 8) & ONES(8);
+
+    // split the quad along the diagonal that keeps ambient occlusion smooth
+    uint a0 = ao & 3u, a1 = (ao >> 2) & 3u, a2 = (ao >> 4) & 3u, a3 = (ao >> 6) & 3u;
+    if (a0 * a3 < a1 * a2)
+        corner = flipped[corner];
+
+    ivec3 a = faceAxes[d];
+    vec2 c = faceCorners[d * 4u + corner];
+    p[a.x] += faceOffsets[d];
+    p[a.y] += c.x * w;
+    p[a.z] += c.y * h;
+
+    aoFactor = aoArr[(ao >> (2u * corner)) & 3u];
+    normal = faceNormals[d];
+
+    // merged quads span several blocks, so texture coordinates come from the
+    // position in the plane of the face and the texture repeats per block
+    vec2 uv = a.x == 0 ? vec2(p.z, -p.y) : a.x == 1 ? vec2(p.x, p.z) : vec2(p.x, -p.y);
+    texCoord = vec3(uv, float(layer));
+
+    vec2 xz = texelFetch(chunkOrigins, record / PAGE_RECORDS).xy;
+    vec3 pos = vec3(p.x + xz.x, p.y, p.z + xz.y);
     gl_Position = camViewProj * vec4(pos, 1.0f);
     projZ = gl_Position.z;
+    viewDepth = gl_Position.w;
     gl_Position.z = (log2(max(1e-6, 1.0 + gl_Position.w)) * FCOEF - 1.0) * gl_Position.w;
 
-    lsPos = sunViewProj * vec4(pos, 1.0f);
+    worldPos = pos;
     viewDir = normalize(pos - camPos);
 }
@@ -1,21 +1,51 @@
 #version 330 core
-layout (location = 0) in uint aVert;
 
-uniform vec2 xz;
-uniform mat4 sunViewProj;
+// face records or shadow caster records, only the first word of a face
+// record is needed and a caster record is nothing else
+uniform usamplerBuffer records;
+uniform samplerBuffer chunkOrigins;
+
+// the cascade being drawn
+uniform int cascade;
 
 #define ONES(n) ((1u << n) - 1u)
 
+// same page size as block.v.glsl, caster records are half the size so
+// twice as many fit a page
+#ifdef CASTER_MESH
+#define PAGE_RECORDS 256
+#else
+#define PAGE_RECORDS 128
+#endif
+
 void main() {
-    uint v = aVert;
+    int record = gl_VertexID / 4;
+    uint corner = uint(gl_VertexID) & 3u;
+    uint v = texelFetch(records, record).x;
 
-    float x = float(v & ONES(4));
+    vec3 p;
+    p.x = float(v & ONES(4));
     v = v >> 4;
-    float z = float(v & ONES(4));
+    p.z = float(v & ONES(4));
     v = v >> 4;
-    float y = float(v & ONES(8));
+    p.y = float(v & ONES(8));
+    v = v >> 8;
+    uint d  = v & ONES(3);
+    v = v >> 3;
+    float w = float(v & ONES(5));
+    v = v >> 5;
+    float h = float(v & ONES(5));
+
+    // which diagonal splits a quad does not matter to its depth, so the
+    // corners of faces.glsl are always walked in order
+    ivec3 a = faceAxes[d];
+    vec2 c = faceCorners[d * 4u + corner];
+    p[a.x] += faceOffsets[d];
+    p[a.y] += c.x * w;
+    p[a.z] += c.y * h;
 
-    vec3 pos = vec3(x + xz.x, y, z + xz.y);
-    gl_Position = sunViewProj * vec4(pos, 1.0f);
+    vec2 xz = texelFetch(chunkOrigins, record / PAGE_RECORDS).xy;
+    vec3 pos = vec3(p.x + xz.x, p.y, p.z + xz.y);
+    gl_Position = cascadeViewProj[cascade] * vec4(pos, 1.0f);
     if (gl_Position.z < -1) gl_Position.z = -1;
 }
@@ -0,0 +1,19 @@
+// the quad of each FaceDir: the axis it faces along and the two its sides
+// run along, where it lies on its axis and the corners in the order of
+// their ambient occlusion values. put in front of every vertex shader by
+// compileShader in rendering/shader.cpp, the axes have to match faceAxes
+// in world/block.cpp
+const ivec3 faceAxes[6] = ivec3[6](
+    ivec3(2, 0, 1), ivec3(2, 0, 1),
+    ivec3(0, 2, 1), ivec3(0, 2, 1),
+    ivec3(1, 0, 2), ivec3(1, 0, 2)
+);
+const float faceOffsets[6] = float[6](0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f);
+const vec2 faceCorners[24] = vec2[24](
+    vec2(0, 0), vec2(0, 1), vec2(1, 0), vec2(1, 1),
+    vec2(1, 0), vec2(1, 1), vec2(0, 0), vec2(0, 1),
+    vec2(0, 0), vec2(0, 1), vec2(1, 0), vec2(1, 1),
+    vec2(1, 0), vec2(1, 1), vec2(0, 0), vec2(0, 1),
+    vec2(0, 0), vec2(0, 1), vec2(1, 0), vec2(1, 1),
+    vec2(1, 1), vec2(0, 1), vec2(1, 0), vec2(0, 0)
+);
@@ -0,0 +1,17 @@
+// per frame data, put in front of every shader by compileShader in
+// rendering/shader.cpp and laid out like FrameUniforms in
+// scene/frameUniforms.hpp
+layout (std140, row_major) uniform Frame {
+    mat4 camViewProj;
+    mat4 cascadeViewProj[4];
+    mat4 sunModelViewProj;
+    mat4 skyModelViewProj;
+    vec4 cascadeRects[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;
+    int  cascadeCount;
+    vec3 camPos;
+    vec3 sunDirection;
+    vec3 sunAmbient;
+    vec3 sunDiffuse;
+};
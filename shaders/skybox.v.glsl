@@ -3,10 +3,8 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 modelviewproj;
-
 void main()
 {
     TexCoords = aPos;
-    gl_Position = modelviewproj * vec4(aPos, 1.0f);
+    gl_Position = skyModelViewProj * vec4(aPos, 1.0f);
 }
@@ -1,18 +1,12 @@
 #include "window/window.hpp"
 #include "scene/scene.hpp"
+#include "utility/assets.hpp"
 #include "glad/glad.h"
 
 #include <chrono>
 #include <cstdio>
 
 int main() {
-    Window::Config cfg = { "Block Game" };
-    Window::initialize(cfg);
-    if (!gladLoadGL())
-        die("failed to init glad");
-
-    Window::swapInterval(0);
-
     std::chrono::high_resolution_clock clock;
     f32 deltaTime = 0;
 
@@ -22,7 +16,19 @@ int main() {
         return d.count();
     };
 
+    // the files load on worker threads while the window comes up
+    auto start = clock.now();
+    Scene::queueAssets();
+
+    Window::Config cfg = { "Block Game" };
+    Window::initialize(cfg);
+    if (!gladLoadGL())
+        die("failed to init glad");
+
+    Window::swapInterval(0);
+
     Scene scene;
+    bool firstFrame = true;
     while (!Window::shouldClose()) {
         auto t1 = clock.now();
 
@@ -35,12 +41,23 @@ int main() {
         scene.render();
         Window::swapBuffers();
 
+        if (firstFrame) {
+            printf("first frame after %.1f ms\n", diff(start));
+            const ShaderCacheStats &sc = Shader::getCacheStats();
+            printf("shader cache: %u hits, %u misses\n", sc.hits, sc.misses);
+            firstFrame = false;
+        }
+
         deltaTime = diff(t1);
         if (deltaTime < 16)
             Window::sleep(16 - deltaTime);
         deltaTime = diff(t1);
     }
 
+    // images that missed their cache are written out for the next run
+    // while the game runs, a write still going holds up the exit instead
+    // of a frame
+    Assets::release();
     Window::terminate();
 
     return 0;
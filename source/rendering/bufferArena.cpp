@@ -0,0 +1,145 @@
+#include "glad/glad.h"
+#include "bufferArena.hpp"
+
+static inline u32 roundToPage(u32 size)
+{
+    return (size + BufferArena::pageSize - 1) / BufferArena::pageSize * BufferArena::pageSize;
+}
+
+static u32 texelSize(u32 format)
+{
+    switch (format) {
+        case GL_R32UI   : return 4;
+        case GL_RG32UI  : return 8;
+        case GL_RGBA32UI: return 16;
+        default: ASSERT(0, "unsupported record format"); return 0;
+    }
+}
+
+BufferArena::BufferArena(u32 capacity, u32 unit, u32 format) :
+    m_vao(DYNAMIC), m_unit(unit), m_format(format)
+{
+    m_capacity = roundToPage(capacity);
+    m_used = 0;
+    m_free.push_back({0, m_capacity});
+
+    // GL only promises 65536 texels, actual limits are in the millions
+    i32 texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+    u64 max = (u64)texels * texelSize(format);
+    m_maxCapacity = max < 0x80000000u ? (u32)max / pageSize * pageSize : 0x80000000u;
+    if (m_capacity > m_maxCapacity)
+        die("buffer of %u bytes is larger than a texture buffer can address", m_capacity);
+
+    glGenTextures(1, &m_texture);
+    m_vao.bind();
+    m_vao.resize(m_capacity, 0, nullptr);
+    _attachTexture();
+}
+
+BufferArena::~BufferArena()
+{
+    glDeleteTextures(1, &m_texture);
+}
+
+void BufferArena::_attachTexture()
+{
+    glActiveTexture(GL_TEXTURE0 + m_unit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, m_format, m_vao.getBuffer());
+    glActiveTexture(GL_TEXTURE0);
+}
+
+u32 BufferArena::allocate(u32 size)
+{
+    ASSERT(size, "empty allocation");
+    size = roundToPage(size);
+
+    u32 i = 0;
+    while (i < m_free.size() && m_free[i].size < size)
+        i ++;
+    if (i == m_free.size()) {
+        _grow(size);
+        i = (u32)m_free.size() - 1;
+    }
+
+    Range &r = m_free[i];
+    u32 offset = r.offset;
+    r.offset += size;
+    r.size -= size;
+    if (!r.size)
+        m_free.erase(m_free.begin() + i);
+
+    m_used += size;
+    return offset;
+}
+
+void BufferArena::free(u32 offset, u32 size)
+{
+    ASSERT(size, "empty allocation");
+    size = roundToPage(size);
+    ASSERT(offset + size <= m_capacity && size <= m_used, "invalid range");
+    m_used -= size;
+
+    // merge with the free ranges on either side
+    u32 i = 0;
+    while (i < m_free.size() && m_free[i].offset < offset)
+        i ++;
+    bool prev = i > 0 && m_free[i - 1].offset + m_free[i - 1].size == offset;
+    bool next = i < m_free.size() && offset + size == m_free[i].offset;
+
+    if (prev && next) {
+        m_free[i - 1].size += size + m_free[i].size;
+        m_free.erase(m_free.begin() + i);
+    } else if (prev) {
+        m_free[i - 1].size += size;
+    } else if (next) {
+        m_free[i].offset = offset;
+        m_free[i].size += size;
+    } else {
+        m_free.insert(m_free.begin() + i, {offset, size});
+    }
+}
+
+void BufferArena::_grow(u32 size)
+{
+    u32 capacity = m_capacity;
+    u32 tail = !m_free.empty() && m_free.back().offset + m_free.back().size == m_capacity ? m_free.back().size : 0;
+    while (tail + capacity - m_capacity < size)
+        capacity *= 2;
+    if (capacity > m_maxCapacity)
+        die("buffer of %u bytes is larger than a texture buffer can address", capacity);
+
+    BufferCopy c = {0, 0, m_capacity};
+    m_vao.bind();
+    m_vao.resize(capacity, 1, &c);
+    _attachTexture();
+
+    if (tail)
+        m_free.back().size += capacity - m_capacity;
+    else
+        m_free.push_back({m_capacity, capacity - m_capacity});
+    m_capacity = capacity;
+}
+
+void BufferArena::write(u32 offset, u32 size, const void *data)
+{
+    ASSERT(offset + size <= m_capacity, "write out of range");
+    m_vao.bind();
+    m_vao.subData(size, (void *)data, offset);
+}
+
+void BufferArena::copy(u32 src, u32 dst, u32 size)
+{
+    ASSERT(src + size <= m_capacity && dst + size <= m_capacity, "copy out of range");
+    m_vao.bind();
+    glCopyBufferSubData(GL_ARRAY_BUFFER, GL_ARRAY_BUFFER, src, dst, size);
+}
+
+void BufferArena::bind()
+{
+    m_vao.bind();
+    glActiveTexture(GL_TEXTURE0 + m_unit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    glActiveTexture(GL_TEXTURE0);
+}
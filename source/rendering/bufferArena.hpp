@@ -0,0 +1,52 @@
+#pragma once
+
+#include "utility/common.hpp"
+#include "vertexArray.hpp"
+#include <vector>
+
+// one buffer shared by many meshes, each mesh lives in a range of it handed
+// out by a first fit free list. sizes are rounded up to whole pages and the
+// buffer doubles when no free range is large enough
+// the meshes have no vertex attributes, the shaders fetch their records
+// through a texture buffer of the given format over the whole buffer
+class BufferArena {
+public:
+    static constexpr u32 pageSize = 1024;
+
+     BufferArena(u32 capacity, u32 unit, u32 format);
+    ~BufferArena();
+
+    // offset in bytes of a new range of at least size bytes
+    u32  allocate(u32 size);
+    void free(u32 offset, u32 size);
+
+    void write(u32 offset, u32 size, const void *data);
+    void copy(u32 src, u32 dst, u32 size);
+    // binds the vertex array and the texture buffer
+    void bind();
+
+    inline u32 getTextureUnit() const { return m_unit; }
+    inline u32 getCapacity() const { return m_capacity; }
+    inline u32 getUsed() const { return m_used; }
+
+private:
+    struct Range { u32 offset, size; };
+
+    VertexArray m_vao;
+    u32 m_texture;
+    u32 m_unit, m_format;
+    u32 m_maxCapacity; // bytes the texture buffer can address
+    std::vector<Range> m_free; // sorted by offset, never adjacent
+    u32 m_capacity, m_used;
+
+    /// <summary>
+    /// Points the texture buffer at the storage of the vertex buffer, which
+    /// is replaced whenever it grows
+    /// </summary>
+    void _attachTexture();
+
+    /// <summary>
+    /// Doubles the buffer until a free range of size bytes fits at its end
+    /// </summary>
+    void _grow(u32 size);
+};
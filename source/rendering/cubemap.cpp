@@ -1,26 +1,44 @@
 #include "glad/glad.h"
+#include "utility/assets.hpp"
 #include "utility/png.hpp"
 #include "rendering/cubemap.hpp"
 
+#define CUBEMAP_BAND_ROWS 64
+
 Cubemap::Cubemap(u32 u, Paths p)
 {
     m_unit = u;
-    u32 width, height;
     glGenTextures(1, &m_texture);
     glActiveTexture(GL_TEXTURE0 + u);
     glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
 
+    // a face that missed its cache goes up a band of rows at a time as it
+    // is decoded
+    u8 *band = nullptr;
+    size_t bandSize = 0;
     for (u32 i = 0; i < 6; i++) {
-        u8 *data = loadPNGFromFile(p.paths[i], &width, &height);
-        if (data) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA,
-                         width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            free(data);
-        } else {
-            die("while creating texture (%s) :\n%s",
-                p.paths[i], getPNGError());
+        Image img = Assets::takeImage(p.paths[i]);
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA,
+                     img.width, img.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.pixels);
+        if (img.decoder) {
+            size_t pitch = (size_t)img.width * 4;
+            if (bandSize < pitch * CUBEMAP_BAND_ROWS) {
+                bandSize = pitch * CUBEMAP_BAND_ROWS;
+                band = (u8 *)realloc(band, bandSize);
+                if (!band)
+                    die("while creating texture (%s) :\nout of memory", p.paths[i]);
+            }
+            for (u32 y = 0; y < img.height; y += CUBEMAP_BAND_ROWS) {
+                u32 rows = img.height - y < CUBEMAP_BAND_ROWS ? img.height - y : CUBEMAP_BAND_ROWS;
+                if (!img.decoder->readRows(band, rows, pitch))
+                    die("while creating texture (%s) :\n%s", p.paths[i], getPNGError());
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, y,
+                                img.width, rows, GL_RGBA, GL_UNSIGNED_BYTE, band);
+            }
         }
+        freeImage(img);
     }
+    free(band);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
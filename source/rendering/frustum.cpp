@@ -0,0 +1,126 @@
+#include "frustum.hpp"
+#include "utility/cpu.hpp"
+#include <math.h>
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+Frustum::Frustum(const Mat4 &m, u32 mask)
+{
+    // clip space x, y and z lie within [-w, w], so every plane is the last
+    // row of the matrix plus or minus one of the others
+    const Vec4 all[6] = {
+        m[3] + m[0], m[3] - m[0],
+        m[3] + m[1], m[3] - m[1],
+        m[3] + m[2], m[3] - m[2],
+    };
+
+    count = 0;
+    for (u32 i = 0; i < 6; i ++)
+        if (mask & (1 << i))
+            planes[count++] = all[i];
+}
+
+typedef u32 (*CullKernel)(const Frustum &f, const BoxList &b, u32 start, u8 *visible);
+
+// a box is outside a plane when even its corner furthest along the normal
+// is behind it, the distance to that corner is the distance to the center
+// plus the extents projected on the absolute value of the normal
+static u32 cullScalar(const Frustum &f, const BoxList &b, u32 start, u8 *visible)
+{
+    u32 n = 0;
+    for (u32 i = start; i < b.count; i ++) {
+        bool inside = true;
+        for (u32 p = 0; p < f.count && inside; p ++) {
+            const Vec4 &pl = f.planes[p];
+            f32 d = pl.x * b.center[0][i] + pl.y * b.center[1][i] + pl.z * b.center[2][i] + pl.w;
+            f32 r = fabsf(pl.x) * b.extent[0][i] + fabsf(pl.y) * b.extent[1][i] + fabsf(pl.z) * b.extent[2][i];
+            inside = d + r >= 0;
+        }
+        visible[i] = inside;
+        n += inside;
+    }
+    return n;
+}
+
+#if CPU_X86
+static u32 cullSSE2(const Frustum &f, const BoxList &b, u32 start, u8 *visible)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    u32 n = 0, i = start;
+    for (; i + 4 <= b.count; i += 4) {
+        __m128 cx = _mm_loadu_ps(b.center[0] + i);
+        __m128 cy = _mm_loadu_ps(b.center[1] + i);
+        __m128 cz = _mm_loadu_ps(b.center[2] + i);
+        __m128 ex = _mm_loadu_ps(b.extent[0] + i);
+        __m128 ey = _mm_loadu_ps(b.extent[1] + i);
+        __m128 ez = _mm_loadu_ps(b.extent[2] + i);
+
+        __m128 outside = _mm_setzero_ps();
+        for (u32 p = 0; p < f.count; p ++) {
+            const Vec4 &pl = f.planes[p];
+            __m128 a = _mm_set1_ps(pl.x), bb = _mm_set1_ps(pl.y), c = _mm_set1_ps(pl.z);
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(bb, cy)),
+                                  _mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(pl.w)));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, a), ex),
+                                             _mm_mul_ps(_mm_andnot_ps(sign, bb), ey)),
+                                  _mm_mul_ps(_mm_andnot_ps(sign, c), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+
+        u32 mask = ~_mm_movemask_ps(outside) & 15;
+        for (u32 l = 0; l < 4; l ++) {
+            visible[i + l] = (mask >> l) & 1;
+            n += visible[i + l];
+        }
+    }
+
+    return n + cullScalar(f, b, i, visible);
+}
+
+TARGET_AVX2 static u32 cullAVX2(const Frustum &f, const BoxList &b, u32 start, u8 *visible)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    u32 n = 0, i = start;
+    for (; i + 8 <= b.count; i += 8) {
+        __m256 cx = _mm256_loadu_ps(b.center[0] + i);
+        __m256 cy = _mm256_loadu_ps(b.center[1] + i);
+        __m256 cz = _mm256_loadu_ps(b.center[2] + i);
+        __m256 ex = _mm256_loadu_ps(b.extent[0] + i);
+        __m256 ey = _mm256_loadu_ps(b.extent[1] + i);
+        __m256 ez = _mm256_loadu_ps(b.extent[2] + i);
+
+        __m256 outside = _mm256_setzero_ps();
+        for (u32 p = 0; p < f.count; p ++) {
+            const Vec4 &pl = f.planes[p];
+            __m256 a = _mm256_set1_ps(pl.x), bb = _mm256_set1_ps(pl.y), c = _mm256_set1_ps(pl.z);
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(bb, cy)),
+                                     _mm256_add_ps(_mm256_mul_ps(c, cz), _mm256_set1_ps(pl.w)));
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(sign, a), ex),
+                                                   _mm256_mul_ps(_mm256_andnot_ps(sign, bb), ey)),
+                                     _mm256_mul_ps(_mm256_andnot_ps(sign, c), ez));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+
+        u32 mask = ~_mm256_movemask_ps(outside) & 255;
+        for (u32 l = 0; l < 8; l ++) {
+            visible[i + l] = (mask >> l) & 1;
+            n += visible[i + l];
+        }
+    }
+
+    return n + cullSSE2(f, b, i, visible);
+}
+#endif
+
+u32 cullBoxes(const Frustum &frustum, const BoxList &boxes, u8 *visible)
+{
+    static const CullKernel kernel =
+#if CPU_X86
+        cpuHasAVX2() ? cullAVX2 :
+        cpuHasSSE2() ? cullSSE2 :
+#endif
+        cullScalar;
+    return kernel(frustum, boxes, 0, visible);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "utility/common.hpp"
+#include "math/matrix.hpp"
+
+enum FrustumPlane : u32 {
+    PLANE_LEFT   = 1 << 0,
+    PLANE_RIGHT  = 1 << 1,
+    PLANE_BOTTOM = 1 << 2,
+    PLANE_TOP    = 1 << 3,
+    PLANE_NEAR   = 1 << 4,
+    PLANE_FAR    = 1 << 5,
+    PLANES_ALL   = (1 << 6) - 1,
+};
+
+// planes of a view projection matrix facing inwards, a point p is on the
+// inner side of a plane when dot(plane, Vec4(p, 1)) >= 0
+struct Frustum {
+    Vec4 planes[6];
+    u32  count;
+
+    // only the planes in mask are kept, a pass that does not clip against
+    // some plane should not cull against it either
+    Frustum(const Mat4 &viewProj, u32 mask = PLANES_ALL);
+};
+
+// axis aligned boxes as centers and half extents, one array per axis
+struct BoxList {
+    const f32 *center[3];
+    const f32 *extent[3];
+    u32 count;
+};
+
+// sets visible[i] to 1 for the boxes that are not entirely outside one of
+// the planes and to 0 for the rest, returns the number of visible boxes
+// boxes are tested 8 or 4 at a time when AVX2 or SSE2 is available
+u32 cullBoxes(const Frustum &frustum, const BoxList &boxes, u8 *visible);
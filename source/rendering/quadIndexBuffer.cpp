@@ -0,0 +1,45 @@
+#include "quadIndexBuffer.hpp"
+#include "glad/glad.h"
+#include <vector>
+
+QuadIndexBuffer::QuadIndexBuffer(u32 quads)
+{
+    glGenBuffers(1, &m_buffer);
+    m_quads = 0;
+    reserve(quads);
+}
+
+QuadIndexBuffer::~QuadIndexBuffer()
+{
+    glDeleteBuffers(1, &m_buffer);
+}
+
+void QuadIndexBuffer::reserve(u32 quads)
+{
+    if (quads <= m_quads)
+        return;
+    u32 n = m_quads ? m_quads : 1;
+    while (n < quads)
+        n *= 2;
+
+    // corners 0 and 3 of a quad are opposite each other, the triangles
+    // share that diagonal. meshes pick the other one by writing the
+    // corners in a different order
+    std::vector<u32> indices(n * QUAD_INDICES);
+    static const u32 pattern[QUAD_INDICES] = {0, 1, 3, 0, 3, 2};
+    for (u32 q = 0; q < n; q ++)
+        for (u32 i = 0; i < QUAD_INDICES; i ++)
+            indices[q * QUAD_INDICES + i] = q * QUAD_VERTS + pattern[i];
+
+    // filled through the copy target so the element array binding of
+    // whichever vertex array is bound stays as it is
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(u32), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_quads = n;
+}
+
+void QuadIndexBuffer::bind() const
+{
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buffer);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "utility/common.hpp"
+
+// vertices and indices of a quad, the vertex shader works out which corner
+// of which quad it is from the index of the vertex
+constexpr u32 QUAD_VERTS   = 4;
+constexpr u32 QUAD_INDICES = 6;
+
+// an index buffer drawing consecutive groups of four vertices as quads,
+// the same indices serve every mesh made of quads when drawn with a base
+// vertex. it only depends on the number of quads so it is built once and
+// grown when a draw needs more
+class QuadIndexBuffer {
+public:
+     QuadIndexBuffer(u32 quads);
+    ~QuadIndexBuffer();
+
+    // makes sure draws of up to quads quads are covered
+    void reserve(u32 quads);
+    // attaches the indices to the bound vertex array
+    void bind() const;
+
+    inline u32 getQuadCount() const { return m_quads; }
+private:
+    u32 m_buffer;
+    u32 m_quads;
+};
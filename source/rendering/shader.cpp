@@ -1,5 +1,9 @@
 #include "glad/glad.h"
 #include "rendering/shader.hpp"
+#include "utility/assets.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <string>
 
 static const char *shaderTypeToString(u32 type)
 {
@@ -8,36 +12,176 @@ static const char *shaderTypeToString(u32 type)
            "unknown";
 }
 
-static u32 compileShader(u32 type, const char *path)
+// put in front of the sources of every program after the defines, either
+// both stages or the one given
+static const struct {
+    const char *path;
+    u32 stage;
+} shaderHeaderFiles[] = {
+    { "../shaders/frame.glsl", 0 },
+    { "../shaders/faces.glsl", GL_VERTEX_SHADER },
+};
+#define SHADER_HEADER_COUNT (sizeof(shaderHeaderFiles) / sizeof(*shaderHeaderFiles))
+
+static const MappedFile *shaderHeaders()
+{
+    static MappedFile headers[SHADER_HEADER_COUNT];
+    static bool loaded = false;
+    if (!loaded) {
+        for (u32 i = 0; i < SHADER_HEADER_COUNT; i ++)
+            headers[i] = Assets::takeText(shaderHeaderFiles[i].path);
+        loaded = true;
+    }
+    return headers;
+}
+
+void Shader::queueAssets()
+{
+    for (u32 i = 0; i < SHADER_HEADER_COUNT; i ++)
+        Assets::queueText(shaderHeaderFiles[i].path);
+}
+
+static u32 compileShader(u32 type, const MappedFile &file, const char *defines)
 {
-    size_t size;
-    char *src = (char *)readEntireFile(path, &size);
-    if (!src)
-        die("failed to open file %s", path);
+    // the mapped source has no terminator, the lengths are passed instead
+    // the defines and the headers go right after the #version line, which
+    // has to be first. #line numbers the headers as source strings of their
+    // own and puts the file back in step after them, so errors point at the
+    // right line of the right file
+    const char *src = (const char *)file.getData();
+    GLint size = (GLint)file.getSize();
+    GLint head = 0;
+    if (size > 8 && !memcmp(src, "#version", 8)) {
+        const char *nl = (const char *)memchr(src, '\n', size);
+        head = nl ? (GLint)(nl - src + 1) : size;
+    }
+
+    const MappedFile *headers = shaderHeaders();
+    // the #version line, the defines, a #line and each header, a #line and
+    // the rest of the file
+    const u32 count = 2 + 2 * SHADER_HEADER_COUNT + 2;
+    const char *parts[count];
+    GLint lengths[count];
+    char lines[SHADER_HEADER_COUNT + 1][24];
+    u32 n = 0;
+    parts[n] = src, lengths[n ++] = head;
+    parts[n] = defines, lengths[n ++] = (GLint)strlen(defines);
+    for (u32 i = 0; i < SHADER_HEADER_COUNT; i ++) {
+        if (shaderHeaderFiles[i].stage && shaderHeaderFiles[i].stage != type)
+            continue;
+        snprintf(lines[i], sizeof(lines[i]), "#line 1 %u\n", i + 1);
+        parts[n] = lines[i], lengths[n ++] = (GLint)strlen(lines[i]);
+        parts[n] = (const char *)headers[i].getData(), lengths[n ++] = (GLint)headers[i].getSize();
+    }
+    snprintf(lines[SHADER_HEADER_COUNT], sizeof(lines[0]), "#line %u 0\n", head ? 2 : 1);
+    parts[n] = lines[SHADER_HEADER_COUNT], lengths[n ++] = (GLint)strlen(lines[SHADER_HEADER_COUNT]);
+    parts[n] = src + head, lengths[n ++] = size - head;
+
     const char *sType = shaderTypeToString(type);
     GLuint shader = glCreateShader(type);
-    if (!shader) {
-        free(src);
+    if (!shader)
         die("failed to create %s shader", sType);
-    }
     i32 success = 0;
-    glShaderSource(shader, 1, &src, NULL);
+    glShaderSource(shader, n, parts, lengths);
     glCompileShader(shader);
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
-        free(src);
         char log[512];
         glGetShaderInfoLog(shader, 512, nullptr, log);
         die("while compiling %s shader:\n%s", sType, log);
     }
-    free(src);
     return shader;
 }
 
-Shader::Shader(const char *vpath, const char *fpath)
+//
+// program binaries
+//
+
+#define PROGRAM_CACHE_SUFFIX  ".progcache"
+#define PROGRAM_CACHE_MAGIC   0x31435250 // "PRC1"
+
+ShaderCacheStats Shader::s_cacheStats = {};
+
+// followed by the binary
+struct ProgramCacheHeader {
+    u32 magic;
+    u32 format;
+    u64 key;
+    u64 length;
+};
+
+static u64 hashBytes(u64 h, const void *data, size_t size)
+{
+    const u8 *p = (const u8 *)data;
+    for (size_t i = 0; i < size; i ++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static u64 hashString(u64 h, const char *s)
+{
+    // the terminator keeps neighbouring strings apart
+    return hashBytes(h, s ? s : "", s ? strlen(s) + 1 : 1);
+}
+
+// binaries only load back into the driver that made them, so the driver
+// strings go into the key along with the sources
+static u64 programKey(const MappedFile &vsrc, const MappedFile &fsrc, const char *defines)
+{
+    u64 h = 14695981039346656037ull;
+    h = hashString(h, (const char *)glGetString(GL_VENDOR));
+    h = hashString(h, (const char *)glGetString(GL_RENDERER));
+    h = hashString(h, (const char *)glGetString(GL_VERSION));
+    h = hashBytes(h, vsrc.getData(), vsrc.getSize());
+    h = hashBytes(h, fsrc.getData(), fsrc.getSize());
+    const MappedFile *headers = shaderHeaders();
+    for (u32 i = 0; i < SHADER_HEADER_COUNT; i ++)
+        h = hashBytes(h, headers[i].getData(), headers[i].getSize());
+    h = hashString(h, defines);
+    return h;
+}
+
+static bool programBinarySupported()
+{
+    static const bool supported = [] {
+        if (!GLAD_GL_ARB_get_program_binary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }();
+    return supported;
+}
+
+Shader::Shader(const char *vpath, const char *fpath, const char *defines) :
+    Shader(vpath, Assets::takeText(vpath), Assets::takeText(fpath), defines)
 {
-    u32 vsh = compileShader(GL_VERTEX_SHADER, vpath);
-    u32 fsh = compileShader(GL_FRAGMENT_SHADER, fpath);
+}
+
+Shader::Shader(const char *vpath, const MappedFile &vsrc, const MappedFile &fsrc, const char *defines)
+{
+    // every set of defines gets a cache file of its own
+    std::string cachePath = vpath;
+    if (*defines) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%08x", (u32)hashString(14695981039346656037ull, defines));
+        cachePath += suffix;
+    }
+    cachePath += PROGRAM_CACHE_SUFFIX;
+
+    bool useCache = programBinarySupported();
+    u64 key = useCache ? programKey(vsrc, fsrc, defines) : 0;
+    if (useCache && _loadBinary(cachePath.c_str(), key)) {
+        s_cacheStats.hits ++;
+        return;
+    }
+    if (useCache)
+        s_cacheStats.misses ++;
+
+    u32 vsh = compileShader(GL_VERTEX_SHADER, vsrc, defines);
+    u32 fsh = compileShader(GL_FRAGMENT_SHADER, fsrc, defines);
 
     m_program = glCreateProgram();
     if (!m_program)
@@ -45,6 +189,8 @@ Shader::Shader(const char *vpath, const char *fpath)
 
     glAttachShader(m_program, vsh);
     glAttachShader(m_program, fsh);
+    if (useCache)
+        glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
     GLint success = 0;
     glLinkProgram(m_program);
@@ -59,6 +205,70 @@ Shader::Shader(const char *vpath, const char *fpath)
     glDetachShader(m_program, fsh);
     glDeleteShader(vsh);
     glDeleteShader(fsh);
+
+    if (useCache)
+        _saveBinary(cachePath.c_str(), key);
+}
+
+bool Shader::_loadBinary(const char *cachePath, u64 key)
+{
+    MappedFile file(cachePath);
+    if (!file.isOpen() || file.getSize() < sizeof(ProgramCacheHeader))
+        return false;
+
+    ProgramCacheHeader h;
+    memcpy(&h, file.getData(), sizeof(h));
+    if (h.magic != PROGRAM_CACHE_MAGIC || h.key != key ||
+        h.length != file.getSize() - sizeof(h) || h.length > INT32_MAX)
+        return false;
+
+    m_program = glCreateProgram();
+    if (!m_program)
+        die("failed to create program");
+
+    // the driver may still turn the binary down, after an update for one
+    GLint success = 0;
+    glProgramBinary(m_program, h.format, file.getData() + sizeof(h), (GLsizei)h.length);
+    glGetProgramiv(m_program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(m_program);
+        m_program = 0;
+        return false;
+    }
+    return true;
+}
+
+void Shader::_saveBinary(const char *cachePath, u64 key) const
+{
+    GLint length = 0;
+    glGetProgramiv(m_program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    u8 *binary = (u8 *)malloc(length);
+    if (!binary)
+        return;
+    ProgramCacheHeader h = {};
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(m_program, length, &written, &format, binary);
+    h.magic  = PROGRAM_CACHE_MAGIC;
+    h.format = format;
+    h.key    = key;
+    h.length = (u64)written;
+
+    // through a temporary file so a cut short write is never loaded
+    std::string tmpPath = std::string(cachePath) + ".tmp";
+    FILE *fp = written > 0 ? fopen(tmpPath.c_str(), "wb") : nullptr;
+    if (fp) {
+        bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+                  fwrite(binary, 1, written, fp) == (size_t)written;
+        ok = fclose(fp) == 0 && ok;
+        remove(cachePath);
+        if (!ok || rename(tmpPath.c_str(), cachePath) != 0)
+            remove(tmpPath.c_str());
+    }
+    free(binary);
 }
 
 void Shader::destroy()
@@ -95,6 +305,13 @@ void Shader::uniform(const std::string_view &name, i32 i) const
     glUniform1i(u, i);
 }
 
+void Shader::uniformBlock(const char *name, u32 binding) const
+{
+    u32 index = glGetUniformBlockIndex(m_program, name);
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(m_program, index, binding);
+}
+
 i32 Shader::_uniformLocation(const std::string_view &name) const
 {
     i32 r;
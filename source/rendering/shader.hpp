@@ -5,19 +5,51 @@
 #include <unordered_map>
 #include <string_view>
 
+// program binaries loaded from the cache and programs built from source
+// while the driver supports the cache
+struct ShaderCacheStats {
+    u32 hits;
+    u32 misses;
+};
+
+// linked programs are kept as driver binaries next to the vertex shader and
+// loaded from there while the sources and the driver stay the same
 class Shader
 {
 public:
-    Shader(const char *vpath, const char *fpath);
+    // defines is a block of #define lines put in front of both sources
+    Shader(const char *vpath, const char *fpath, const char *defines = "");
+    Shader(const char *vpath, const MappedFile &vsrc, const MappedFile &fsrc, const char *defines);
     void bind() const;
     void destroy();
     void uniform(const std::string_view &name, Mat4 mat) const;
     void uniform(const std::string_view &name, f32 a, f32 b) const;
     void uniform(const std::string_view &name, Vec3 v3) const;
     void uniform(const std::string_view &name, i32 i) const;
+
+    // points the uniform block called name at a buffer binding point,
+    // blocks the program does not have are skipped
+    void uniformBlock(const char *name, u32 binding) const;
+
+    // starts loading the headers every shader gets
+    static void queueAssets();
+
+    static const ShaderCacheStats &getCacheStats() { return s_cacheStats; }
 private:
     u32 m_program;
     mutable std::unordered_map<std::string_view, i32> m_uniforms;
+    static ShaderCacheStats s_cacheStats;
 
     i32 _uniformLocation(const std::string_view &name) const;
+
+    /// <summary>
+    /// Creates the program from the cached binary, fails when there is none
+    /// for key or the driver does not take it
+    /// </summary>
+    bool _loadBinary(const char *cachePath, u64 key);
+
+    /// <summary>
+    /// Writes the binary of the linked program to the cache
+    /// </summary>
+    void _saveBinary(const char *cachePath, u64 key) const;
 };
@@ -0,0 +1,41 @@
+#include "rendering/shaderVariants.hpp"
+#include "utility/assets.hpp"
+#include <string>
+
+ShaderVariants::ShaderVariants(const char *vpath, const char *fpath, std::vector<const char *> flags, Init init) :
+    m_vpath(vpath),
+    m_vsrc(Assets::takeText(vpath)),
+    m_fsrc(Assets::takeText(fpath)),
+    m_flags(std::move(flags)),
+    m_init(std::move(init))
+{
+    ASSERT(m_flags.size() <= 32, "too many flags");
+}
+
+ShaderVariants::~ShaderVariants()
+{
+    for (auto &it : m_shaders)
+        it.second.destroy();
+}
+
+const Shader &ShaderVariants::get(u32 mask)
+{
+    auto it = m_shaders.find(mask);
+    if (it != m_shaders.end())
+        return it->second;
+
+    std::string defines;
+    for (u32 i = 0; i < m_flags.size(); i ++) {
+        if (mask & (1u << i)) {
+            defines += "#define ";
+            defines += m_flags[i];
+            defines += "\n";
+        }
+    }
+
+    it = m_shaders.emplace(std::piecewise_construct, std::forward_as_tuple(mask),
+                           std::forward_as_tuple(m_vpath, m_vsrc, m_fsrc, defines.c_str())).first;
+    if (m_init)
+        m_init(it->second);
+    return it->second;
+}
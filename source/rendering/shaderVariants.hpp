@@ -0,0 +1,28 @@
+#pragma once
+
+#include "rendering/shader.hpp"
+#include <functional>
+#include <vector>
+
+// programs built from one pair of sources with some combination of a set of
+// flags #defined, each is built the first time its combination is asked for
+// and kept around, so switching between them is just a different program
+class ShaderVariants
+{
+public:
+    // bit i of a mask stands for flags[i], init gets to set up every
+    // program once it is built
+    typedef std::function<void(const Shader &)> Init;
+
+     ShaderVariants(const char *vpath, const char *fpath, std::vector<const char *> flags, Init init = nullptr);
+    ~ShaderVariants();
+
+    const Shader &get(u32 mask);
+    inline u32 getVariantCount() const { return (u32)m_shaders.size(); }
+private:
+    const char *m_vpath;
+    MappedFile m_vsrc, m_fsrc;
+    std::vector<const char *> m_flags;
+    Init m_init;
+    std::unordered_map<u32, Shader> m_shaders;
+};
@@ -42,3 +42,12 @@ void ShadowMap::prepWrite() const {
     glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
     glClear(GL_DEPTH_BUFFER_BIT);
 }
+
+void ShadowMap::prepWrite(i32 x, i32 y, i32 w, i32 h) const {
+    glViewport(x, y, w, h);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glScissor(x, y, w, h);
+    glEnable(GL_SCISSOR_TEST);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
@@ -15,6 +15,10 @@ public:
     inline u32 getWidth () const { return m_width ; }
     inline u32 getHeight() const { return m_height; }
     void prepWrite() const;
+
+    // binds the framebuffer with the viewport on a part of the map and
+    // clears only that part
+    void prepWrite(i32 x, i32 y, i32 w, i32 h) const;
 private:
     i32 m_width, m_height;
     u32 m_framebuffer;
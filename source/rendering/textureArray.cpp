@@ -1,15 +1,13 @@
 #include "rendering/textureArray.hpp"
+#include "utility/assets.hpp"
 #include "utility/png.hpp"
 #include "glad/glad.h"
-#include <memory.h>
 
 TextureArray::TextureArray(u32 u, const char *path, int x, int y)
 {
-    u32 imgW, imgH;
-
-    u8 *data = loadPNGFromFile(path, &imgW, &imgH);
-    if (!data)
-        die("while creating texture array: %s\n", getPNGError());
+    Image img = Assets::takeImage(path, MIP_CHAIN);
+    u32 imgW = img.width;
+    u32 imgH = img.height;
     tileX = x;
     tileY = y;
 
@@ -19,34 +17,63 @@ TextureArray::TextureArray(u32 u, const char *path, int x, int y)
     u32 imageCount = tileX * tileY;
     unit = u;
 
+    // a level of the image holds the same level of every tile as long as
+    // the tiles divide the image and halve evenly
+    u32 levels = 1;
+    if (imgW == tileW * tileX && imgH == tileH * tileY)
+        while (levels < img.levels && !((tileW >> (levels - 1)) & 1) && !((tileH >> (levels - 1)) & 1))
+            levels ++;
+
     glGenTextures(1, &id);
     glActiveTexture(GL_TEXTURE0 + u);
     glBindTexture(GL_TEXTURE_2D_ARRAY, id);
-    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, tileW, tileH, imageCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    for (u32 l = 0; l < levels; l ++)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGBA, tileW >> l, tileH >> l, imageCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    u32 tileSizeX = tileW * 4;
-    u32 rowlen = tileSizeX * tileX;
-    u32 tileRowSize = rowlen * tileH;
-    u8 *tile = new u8[tileSizeX * tileH];
-
-    for (u32 iy = 0; iy < tileY; ++iy) {
-        for (u32 ix = 0; ix < tileX; ++ix) {
-            u8 *ptr = data + iy * tileRowSize + ix * tileSizeX;
-            for (u32 row = 0; row < tileH; ++row)
-                memcpy(tile + row * tileSizeX, ptr + row * rowlen, tileSizeX);
-
-            int i = iy * tileX + ix;
-            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, tileW, tileH, 1, GL_RGBA, GL_UNSIGNED_BYTE, tile);
+    // the tiles are picked out of the image by the row length of the upload.
+    // an image that missed its cache is decoded a row of tiles at a time
+    if (img.decoder) {
+        size_t pitch = (size_t)imgW * 4;
+        u8 *band = new u8[pitch * tileH];
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, imgW);
+        for (u32 iy = 0; iy < tileY; ++iy) {
+            if (!img.decoder->readRows(band, tileH, pitch))
+                die("while creating texture array: %s\n", getPNGError());
+            for (u32 ix = 0; ix < tileX; ++ix) {
+                int i = iy * tileX + ix;
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, tileW, tileH, 1, GL_RGBA, GL_UNSIGNED_BYTE, band + (size_t)ix * tileW * 4);
+            }
+        }
+        delete[] band;
+    } else {
+        for (u32 l = 0; l < levels; l ++) {
+            u32 w = tileW >> l, h = tileH >> l;
+            u32 rowlen = imageLevelWidth(img, l);
+            const u8 *data = imageLevel(img, l);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, rowlen);
+            for (u32 iy = 0; iy < tileY; ++iy) {
+                for (u32 ix = 0; ix < tileX; ++ix) {
+                    const u8 *ptr = data + ((size_t)iy * h * rowlen + ix * w) * 4;
+                    int i = iy * tileX + ix;
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, i, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, ptr);
+                }
+            }
         }
     }
-    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    // otherwise GL makes the levels
+    if (levels > 1)
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    else
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
 
-    delete[] tile;
+    freeImage(img);
     glActiveTexture(GL_TEXTURE0);
 }
 
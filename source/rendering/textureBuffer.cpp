@@ -0,0 +1,44 @@
+#include "textureBuffer.hpp"
+#include "glad/glad.h"
+
+TextureBuffer::TextureBuffer(u32 unit, u32 format, u32 size) :
+    m_unit(unit), m_format(format), m_size(0)
+{
+    glGenBuffers(1, &m_buffer);
+    glGenTextures(1, &m_texture);
+    resize(size);
+}
+
+TextureBuffer::~TextureBuffer()
+{
+    glDeleteTextures(1, &m_texture);
+    glDeleteBuffers(1, &m_buffer);
+}
+
+void TextureBuffer::resize(u32 size)
+{
+    m_size = size;
+    glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0 + m_unit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, m_format, m_buffer);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void TextureBuffer::subData(u32 offset, u32 size, const void *data)
+{
+    ASSERT(offset + size <= m_size, "write out of range");
+    glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, offset, size, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void TextureBuffer::bind() const
+{
+    glActiveTexture(GL_TEXTURE0 + m_unit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "utility/common.hpp"
+
+// a buffer object read from shaders through texelFetch on a samplerBuffer
+class TextureBuffer {
+public:
+     TextureBuffer(u32 unit, u32 format, u32 size);
+    ~TextureBuffer();
+
+    // contents are lost when the size changes
+    void resize(u32 size);
+    void subData(u32 offset, u32 size, const void *data);
+    void bind() const;
+
+    inline u32 getTextureUnit() const { return m_unit; }
+    inline u32 getSize() const { return m_size; }
+private:
+    u32 m_buffer, m_texture;
+    u32 m_unit, m_format, m_size;
+};
@@ -0,0 +1,26 @@
+#include "uniformBuffer.hpp"
+#include "glad/glad.h"
+
+UniformBuffer::UniformBuffer(u32 binding, u32 size) :
+    m_binding(binding), m_size(size)
+{
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, m_buffer);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    glDeleteBuffers(1, &m_buffer);
+}
+
+void UniformBuffer::setData(const void *data)
+{
+    // respecifying the storage lets the driver hand out a fresh one instead
+    // of waiting on the draws still reading last frame's contents
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, m_size, data, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "utility/common.hpp"
+
+// a buffer object bound to a uniform block binding point, the layout of the
+// data is up to the caller and has to match the std140 block in the shaders
+class UniformBuffer {
+public:
+     UniformBuffer(u32 binding, u32 size);
+    ~UniformBuffer();
+
+    // replaces the whole contents
+    void setData(const void *data);
+
+    inline u32 getBinding() const { return m_binding; }
+    inline u32 getSize() const { return m_size; }
+private:
+    u32 m_buffer;
+    u32 m_binding, m_size;
+};
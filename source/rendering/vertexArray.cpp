@@ -33,6 +33,31 @@ void VertexArray::subData(u32 size, void *data, u32 offset)
     glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
 }
 
+void VertexArray::resize(u32 size, u32 ncopies, const BufferCopy *copies)
+{
+    // the old contents are staged in a temporary buffer so the vertex
+    // buffer keeps its name and the attribute bindings stay valid
+    u32 tmp = 0;
+    if (ncopies) {
+        glGenBuffers(1, &tmp);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, tmp);
+        glBufferData(GL_COPY_WRITE_BUFFER, m_vbsize, NULL, GL_STREAM_COPY);
+        glCopyBufferSubData(GL_ARRAY_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_vbsize);
+    }
+
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, m_usage);
+    m_vbsize = size;
+
+    if (ncopies) {
+        glBindBuffer(GL_COPY_READ_BUFFER, tmp);
+        for (u32 i = 0; i < ncopies; i ++) {
+            ASSERT(copies[i].dst + copies[i].size <= size, "copy out of range");
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, copies[i].src, copies[i].dst, copies[i].size);
+        }
+        glDeleteBuffers(1, &tmp);
+    }
+}
+
 void VertexArray::setAttribs(u32 nattribs, VertexAttrib *attribs)
 {
     ASSERT(nattribs && attribs, "invalid attributes");
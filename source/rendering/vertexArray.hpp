@@ -18,6 +18,11 @@ struct VertexAttrib {
     VertexAttribType type;
 };
 
+// byte range moved from src to dst when a vertex buffer is resized
+struct BufferCopy {
+    u32 src, dst, size;
+};
+
 class VertexArray {
 public:
      VertexArray(VertexUsage usage);
@@ -25,8 +30,10 @@ public:
     ~VertexArray();
     void setData(u32 size, void *data);
     void subData(u32 size, void *data, u32 offset);
+    void resize(u32 size, u32 ncopies, const BufferCopy *copies);
     void setAttribs(u32 nattribs, VertexAttrib *attribs);
     void bind();
+    inline u32 getBuffer() const { return m_vbo; }
 private:
     u32 m_vao, m_vbo;
     u32 m_usage, m_vbsize;
@@ -78,5 +78,7 @@ void Camera::setAspectRatio(f32 ar) {
 }
 
 void Camera::setPlanes(f32 zn, f32 zf) {
+    m_znear = zn;
+    m_zfar  = zf;
     m_proj = mat4Perspective(zn, zf, m_hfov * 2, m_ar);
 }
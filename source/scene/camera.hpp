@@ -50,6 +50,13 @@ class Camera{
         const Vec3 &getPosition() const {return m_position;}
         const Mat4 &getViewMatrix() const {return m_view;}
         const Mat4 &getProjectionMatrix() const {return m_proj;}
+        const Vec3 &getFront() const {return m_front;}
+        const Vec3 &getRight() const {return m_right;}
+        const Vec3 &getUp() const {return m_up;}
+        f32 getHalfFOV() const {return m_hfov;}
+        f32 getAspectRatio() const {return m_ar;}
+        f32 getNear() const {return m_znear;}
+        f32 getFar() const {return m_zfar;}
         void processKeyboard(CameraMovement, f32);
         void processMouseMovement(f32 xoffset, f32 yoffset);
         void updateCamera();
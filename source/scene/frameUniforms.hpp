@@ -0,0 +1,33 @@
+#pragma once
+
+#include "math/matrix.hpp"
+
+// binding point of the Frame block
+#define FRAME_UNIFORM_BINDING 0
+
+// size of the cascade arrays in the Frame block
+#define MAX_SHADOW_CASCADES 4
+
+// everything the shaders need that changes once per frame, written to a
+// single uniform buffer. matches the Frame block in shaders/frame.glsl,
+// which every shader gets. the block is std140 and row_major so the
+// matrices go in as they are. the vectors are vec3 in the shaders, std140
+// pads them to 16 bytes
+struct FrameUniforms {
+    Mat4 camViewProj;
+    Mat4 cascadeViewProj[MAX_SHADOW_CASCADES];
+    Mat4 sunModelViewProj;
+    Mat4 skyModelViewProj;
+    Vec4 cascadeRects[MAX_SHADOW_CASCADES]; // offset and size in the shadow map, in texture coordinates
+    Vec4 cascadeSplits;                     // view depth where each cascade ends
+    Vec4 cascadeBias;                       // depth bias of each cascade
+    i32  cascadeCount;
+    i32  pad[3];
+    Vec4 camPos;
+    Vec4 sunDirection;
+    Vec4 sunAmbient;
+    Vec4 sunDiffuse;
+};
+
+static_assert(sizeof(FrameUniforms) == (3 + MAX_SHADOW_CASCADES) * 64 + (MAX_SHADOW_CASCADES + 7) * 16,
+              "FrameUniforms does not match the std140 layout");
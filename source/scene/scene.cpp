@@ -1,6 +1,8 @@
 #include "scene.hpp"
 #include "glad/glad.h"
 #include "math/matrix.hpp"
+#include "world/chunk.hpp"
+#include "utility/assets.hpp"
 #include <cstdio>
 
 static const Vec3 DEF_CAMERA_POS(-100, 140, 50);
@@ -8,12 +10,65 @@ constexpr u32 RENDER_DISTANCE = 16;
 
 static bool cullFace = true;
 
+// flags of the block shader variants, in the order of blockShaderFlags
+enum BlockShaderFlag : u32 {
+    DO_ENV_MAP  = 1 << 0,
+    DO_LIGHTING = 1 << 1,
+    DO_SHADOW   = 1 << 2,
+    DO_AO       = 1 << 3,
+    DO_FOG      = 1 << 4,
+};
+
+static const struct {
+    u32 key;
+    u32 flag;
+    const char *name;
+} blockShaderKeys[] = {
+    { KEY_1, DO_ENV_MAP , "doEnvMap"   },
+    { KEY_2, DO_LIGHTING, "doLighting" },
+    { KEY_3, DO_SHADOW  , "doShadow"   },
+    { KEY_4, DO_AO      , "doAO"       },
+    { KEY_5, DO_FOG     , "doFog"      },
+};
+
+// cascades further out cover more ground with fewer texels and are drawn
+// less often. they pack into a 4096x2048 map, 8.4M texels with a 1024
+// square unused, against 16.7M for the single 4096 map
+static const ShadowConfig shadowConfig = {
+    4,
+    {2048, 1024, 1024, 1024},
+    {1, 2, 4, 8},
+    0.75f,
+};
+
+#define BLOCK_VERTEX_SHADER    "../shaders/block.v.glsl"
+#define BLOCK_FRAGMENT_SHADER  "../shaders/block.f.glsl"
+#define DEPTH_VERTEX_SHADER    "../shaders/depth.v.glsl"
+#define DEPTH_FRAGMENT_SHADER  "../shaders/depth.f.glsl"
+
+void Scene::queueAssets()
+{
+    Assets::queueText(BLOCK_VERTEX_SHADER);
+    Assets::queueText(BLOCK_FRAGMENT_SHADER);
+    Assets::queueText(DEPTH_VERTEX_SHADER);
+    Assets::queueText(DEPTH_FRAGMENT_SHADER);
+    Shader::queueAssets();
+    World::queueAssets();
+    Sky::queueAssets();
+}
+
 Scene::Scene() :
     m_camera(DEF_CAMERA_POS, 90, 1, Vec3(0, 1, 0), -89),
-    m_blockShader("../shaders/block.v.glsl", "../shaders/block.f.glsl"),
-    m_depthShader("../shaders/depth.v.glsl", "../shaders/depth.f.glsl"),
+    m_blockShaders(BLOCK_VERTEX_SHADER, BLOCK_FRAGMENT_SHADER,
+                   {"DO_ENV_MAP", "DO_LIGHTING", "DO_SHADOW", "DO_AO", "DO_FOG"},
+                   [this](const Shader &shader) { _initBlockShader(shader); }),
+    m_blockFlags(DO_ENV_MAP | DO_LIGHTING | DO_SHADOW | DO_AO | DO_FOG),
+    m_depthShaders(DEPTH_VERTEX_SHADER, DEPTH_FRAGMENT_SHADER, {"CASTER_MESH"},
+                   [](const Shader &shader) { shader.uniformBlock("Frame", FRAME_UNIFORM_BINDING); }),
+    m_frameUniforms(FRAME_UNIFORM_BINDING, sizeof(FrameUniforms)),
+    m_shadows(1, shadowConfig),
     m_world(2 * RENDER_DISTANCE),
-    m_sky(DEF_CAMERA_POS)
+    m_sky()
 {
     glFrontFace(GL_CW);
     glEnable(GL_DEPTH_TEST);
@@ -22,19 +77,9 @@ Scene::Scene() :
     glClearColor(0, 0, 0, 0);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    const Sun &sun = m_sky.getSun();
-    const TextureArray &ta = m_world.getTextureArray();
-    const SkyBox &sb = m_sky.getSkybox();
-    m_blockShader.bind();
-    m_blockShader.uniform("texArray", ta.getTextureUnit());
-    m_blockShader.uniform("skybox", sb.cubemap.getTextureUnit());
-    m_blockShader.uniform("shadowMap", sun.shadowMap.getTextureUnit());
-
-    m_blockShader.uniform("settings.doEnvMap"  , true);
-    m_blockShader.uniform("settings.doLighting", true);
-    m_blockShader.uniform("settings.doShadow"  , true);
-    m_blockShader.uniform("settings.doAO"      , true);
-    m_blockShader.uniform("settings.doFog"     , true);
+    // the other variants are built when they are switched to
+    m_blockShaders.get(m_blockFlags);
+    m_depthShaders.get(m_world.getCasterMeshes() ? 1 : 0);
 
     f32 far = magnitude(Vec3(0, 0, 0) - Vec3((RENDER_DISTANCE + 1) * 15.0f, 0, 0));
     m_camera.setPlanes(0.0001f, far);
@@ -46,6 +91,17 @@ Scene::Scene() :
 Scene::~Scene() {
 }
 
+void Scene::_initBlockShader(const Shader &shader)
+{
+    const TextureArray &ta = m_world.getTextureArray();
+    const SkyBox &sb = m_sky.getSkybox();
+    shader.bind();
+    shader.uniform("texArray", ta.getTextureUnit());
+    shader.uniform("skybox", sb.cubemap.getTextureUnit());
+    shader.uniform("shadowMap", m_shadows.getTextureUnit());
+    shader.uniformBlock("Frame", FRAME_UNIFORM_BINDING);
+}
+
 void Scene::update(const Events &events, f32 deltaTime)
 {
     u32 direction = 0;
@@ -61,40 +117,59 @@ void Scene::update(const Events &events, f32 deltaTime)
     if (events.keyHeld(KEY_K)) m_camera.processMouseMovement( 0,  r);
     if (events.keyHeld(KEY_L)) m_camera.processMouseMovement( r,  0);
 
-    m_blockShader.bind();
-    if (events.keyPressed(KEY_1)){
-        static bool b = true;
-        m_blockShader.uniform("settings.doEnvMap"  , b = !b);
-        printf("settings.doEnvMap = %s\n"  , b ? "true" : "false");
+    for (auto &k : blockShaderKeys) {
+        if (!events.keyPressed(k.key))
+            continue;
+        m_blockFlags ^= k.flag;
+        printf("settings.%s = %s\n", k.name, m_blockFlags & k.flag ? "true" : "false");
     }
 
-    if (events.keyPressed(KEY_2)){
-        static bool b = true;
-        m_blockShader.uniform("settings.doLighting", b = !b);
-        printf("settings.doLighting = %s\n", b ? "true" : "false");
+    if (events.keyPressed(KEY_6)){
+        cullFace = !cullFace;
+        printf("cullFace = %s\n"   , cullFace ? "true" : "false");
     }
 
-    if (events.keyPressed(KEY_3)){
-        static bool b = true;
-        m_blockShader.uniform("settings.doShadow"  , b = !b);
-        printf("settings.doShadow = %s\n"  , b ? "true" : "false");
+    if (events.keyPressed(KEY_C)) {
+        m_shadows.setCaching(!m_shadows.getCaching());
+        printf("cacheShadows = %s\n", m_shadows.getCaching() ? "true" : "false");
     }
 
-    if (events.keyPressed(KEY_4)){
-        static bool b = true;
-        m_blockShader.uniform("settings.doAO"      , b = !b);
-        printf("settings.doAO = %s\n"      , b ? "true" : "false");
+    if (events.keyPressed(KEY_G)) {
+        MeshMode mode = m_world.getMeshMode() == MESH_GREEDY ? MESH_PER_FACE : MESH_GREEDY;
+        m_world.setMeshMode(mode);
+        printf("meshMode = %s\n", mode == MESH_GREEDY ? "greedy" : "per face");
     }
 
-    if (events.keyPressed(KEY_5)){
-        static bool b = true;
-        m_blockShader.uniform("settings.doFog"     , b = !b);
-        printf("settings.doFog = %s\n"     , b ? "true" : "false");
+    if (events.keyPressed(KEY_M)) {
+        m_world.setCasterMeshes(!m_world.getCasterMeshes());
+        printf("casterMeshes = %s\n", m_world.getCasterMeshes() ? "true" : "false");
     }
 
-    if (events.keyPressed(KEY_6)){
-        cullFace = !cullFace;
-        printf("cullFace = %s\n"   , cullFace ? "true" : "false");
+    if (events.keyPressed(KEY_I)) {
+        MeshStats ms = m_world.getMeshStats();
+        u32 nchunks = 4 * RENDER_DISTANCE * RENDER_DISTANCE;
+        printf("mesh: %u quads, %u with per face meshing (%.1f%% fewer), %.3f ms per chunk\n",
+               ms.quadCount, ms.faceQuadCount,
+               ms.faceQuadCount ? 100.0f * (ms.faceQuadCount - ms.quadCount) / ms.faceQuadCount : 0.0f,
+               ms.time / nchunks);
+        if (m_world.getCasterMeshes())
+            printf("shadow casters: %u quads, %.1f%% of the opaque mesh at half the size each\n",
+                   ms.casterQuadCount, ms.quadCount ? 100.0f * ms.casterQuadCount / ms.quadCount : 0.0f);
+        printf("blocks: %.1f KB per chunk, %.1f KB uncompressed\n",
+               m_world.getBlockMemory() / 1024.0f / nchunks, sizeof(BlockGrid) / 1024.0f);
+        const BufferArena &arena = m_world.getArena();
+        printf("face records: %.1f MB used of %.1f MB\n",
+               arena.getUsed() / 1048576.0f, arena.getCapacity() / 1048576.0f);
+        const QuadIndexBuffer &qi = m_world.getQuadIndices();
+        printf("quad indices: %u quads, %.1f MB\n",
+               qi.getQuadCount(), qi.getQuadCount() * QUAD_INDICES * 4 / 1048576.0f);
+        const CullStats &rc = m_world.getRenderCullStats();
+        printf("culling: %u chunks drawn, %u culled\n", rc.drawn, rc.culled);
+        for (u32 i = 0; i < m_shadows.getCount(); i ++) {
+            const ShadowCascade &c = m_shadows.getCascade(i);
+            printf("shadow cascade %u: %d texels up to %.0f, %u chunks drawn, %u culled, %.1f redraws per minute\n",
+                   i, c.size, c.split, c.cull.drawn, c.cull.culled, m_shadows.getRedrawsPerMinute(i));
+        }
     }
 
     f32 s = 1;
@@ -117,43 +192,37 @@ void Scene::update(const Events &events, f32 deltaTime)
     if (events.keyPressed(KEY_R))
         rev = !rev;
 
-    m_sky.update(m_camera, deltaTime * s * rev);
+    m_sky.update(deltaTime * s * rev);
+    m_shadows.update(m_camera, m_sky.getSun().direction, m_world.getMeshGeneration(), deltaTime);
 }
 
 void Scene::render()
 {
-    const Sun &sun = m_sky.getSun();
-    Mat4 sunViewProj = sun.proj * sun.view;
-    Mat4 camViewProj = m_camera.getProjectionMatrix() * m_camera.getViewMatrix();
-
-    m_depthShader.bind();
-    m_depthShader.uniform("sunViewProj", sunViewProj);
-
-    // world shadow pass
-    glDisable(GL_CULL_FACE);
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    sun.shadowMap.prepWrite();
-    m_world.depthPass(m_depthShader, sunViewProj);
-    glDisable(GL_POLYGON_OFFSET_FILL);
+    // every shader reads the per frame values from the one buffer, so they
+    // are written once here instead of once per program
+    FrameUniforms frame = {};
+    frame.camViewProj = m_camera.getProjectionMatrix() * m_camera.getViewMatrix();
+    frame.camPos = Vec4(m_camera.getPosition());
+    m_sky.setFrameUniforms(m_camera, frame);
+    m_shadows.setFrameUniforms(frame);
+    m_frameUniforms.setData(&frame);
+    const Mat4 &camViewProj = frame.camViewProj;
+
+    // world shadow pass, only the cascades that changed are drawn
+    m_shadows.render(m_world, m_depthShaders.get(m_world.getCasterMeshes() ? 1 : 0));
 
     if (cullFace) glEnable(GL_CULL_FACE);
+    else glDisable(GL_CULL_FACE);
 
     // world render pass
     glViewport(0, 0, m_viewport.w, m_viewport.h);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
-    m_blockShader.bind();
-    m_blockShader.uniform("camPos", m_camera.getPosition());
-    m_blockShader.uniform("camViewProj", camViewProj);
-    m_blockShader.uniform("sunViewProj", sunViewProj);
-
-    m_blockShader.uniform("sun.ambient", sun.ambient);
-    m_blockShader.uniform("sun.diffuse", sun.diffuse);
-    m_blockShader.uniform("sun.direction", sun.direction);
-
-    m_world.renderPass(m_blockShader, camViewProj);
+    const Shader &blockShader = m_blockShaders.get(m_blockFlags);
+    blockShader.bind();
+    m_world.renderPass(blockShader, camViewProj);
 
     // draw skybox
-    m_sky.render(m_camera);
+    m_sky.render();
 }
@@ -2,10 +2,13 @@
 
 #include "window/events.hpp"
 #include "rendering/shader.hpp"
-#include "rendering/shadowMap.hpp"
+#include "rendering/shaderVariants.hpp"
+#include "rendering/uniformBuffer.hpp"
 #include "world/world.hpp"
 #include "scene/camera.hpp"
 #include "scene/sky.hpp"
+#include "scene/frameUniforms.hpp"
+#include "scene/shadowCascades.hpp"
 
 class Scene
 {
@@ -15,11 +18,24 @@ public:
     void update(const Events &e, f32 dt);
     void render();
 
+    // starts loading every file the scene needs, before the GL context is
+    // there. the constructor takes them once it is
+    static void queueAssets();
+
 private:
     struct {i32 w, h;} m_viewport;
     Camera m_camera;
-    Shader m_blockShader;
-    Shader m_depthShader;
+    ShaderVariants m_blockShaders;
+    u32 m_blockFlags;
+    ShaderVariants m_depthShaders;
+    UniformBuffer m_frameUniforms;
+    ShadowCascades m_shadows;
     World m_world;
     Sky m_sky;
+
+    /// <summary>
+    /// Points the samplers of a newly built block shader variant at their
+    /// texture units and its Frame block at the per frame uniforms
+    /// </summary>
+    void _initBlockShader(const Shader &shader);
 };
@@ -0,0 +1,161 @@
+#include "shadowCascades.hpp"
+#include "glad/glad.h"
+#include "rendering/shader.hpp"
+#include "world/blockStorage.hpp"
+#include <math.h>
+#include <string.h>
+
+// the camera near plane is far too close for logarithmic splits, they are
+// spaced from one block out instead
+#define SPLIT_NEAR 1.0f
+
+// depth bias in texels of the cascade, about what the single map had
+#define BIAS_TEXELS 5.5f
+
+ShadowCascades::ShadowCascades(u32 unit, const ShadowConfig &config) :
+    m_config(config),
+    m_cascades(),
+    m_map(_createMap(unit, config, m_cascades)),
+    m_caching(true),
+    m_frame(0),
+    m_time(0)
+{
+}
+
+ShadowMap ShadowCascades::_createMap(u32 unit, const ShadowConfig &config, ShadowCascade *cascades)
+{
+    ASSERT(config.count >= 1 && config.count <= MAX_SHADOW_CASCADES, "bad number of shadow cascades");
+    i32 first = (i32)config.resolution[0];
+    i32 width = first, height = first;
+    i32 x = 0, y = 0, shelf = 0;
+    cascades[0].x = 0, cascades[0].y = 0, cascades[0].size = first;
+    for (u32 i = 1; i < config.count; i ++) {
+        i32 size = (i32)config.resolution[i];
+        if (x > 0 && x + size > first) {
+            y += shelf;
+            x = 0, shelf = 0;
+        }
+        cascades[i].x = first + x, cascades[i].y = y, cascades[i].size = size;
+        x += size;
+        shelf = size > shelf ? size : shelf;
+        width  = first + x > width ? first + x : width;
+        height = y + shelf > height ? y + shelf : height;
+    }
+    return ShadowMap(unit, width, height);
+}
+
+void ShadowCascades::setCaching(bool caching)
+{
+    m_caching = caching;
+    m_time = 0;
+    for (u32 i = 0; i < m_config.count; i ++) {
+        m_cascades[i].valid = false;
+        m_cascades[i].redraws = 0;
+    }
+}
+
+f32 ShadowCascades::getRedrawsPerMinute(u32 i) const
+{
+    return m_time > 0 ? m_cascades[i].redraws * 60000.0f / m_time : 0.0f;
+}
+
+void ShadowCascades::update(const Camera &cam, const Vec3 &sunDirection, u32 meshGeneration, f32 deltaTime)
+{
+    m_time += deltaTime;
+    m_frame ++;
+
+    const u32 n = m_config.count;
+    f32 zn = cam.getNear(), zf = cam.getFar();
+    f32 sn = zn > SPLIT_NEAR ? zn : SPLIT_NEAR;
+    f32 th = tanf(cam.getHalfFOV());
+    f32 tw = th * cam.getAspectRatio();
+
+    // the light looks along the sun from a grid that only turns with it
+    Mat4 basis = mat4LookAt(Vec3(), sunDirection, Vec3(0, 1, 0));
+
+    f32 d0 = zn;
+    for (u32 i = 0; i < n; i ++) {
+        ShadowCascade &c = m_cascades[i];
+        f32 t = (f32)(i + 1) / n;
+        f32 d1 = i + 1 == n ? zf : lerp(sn + (zf - sn) * t, sn * powf(zf / sn, t), m_config.lambda);
+
+        // the sphere around the slice from d0 to d1 only depends on the
+        // shape of the view, not on where it looks, so the size of the map
+        // stays put while the camera turns. it is worked out in view space
+        // and rounded up to whole blocks to keep rounding errors out
+        f32 zc = (d0 + d1) / 2;
+        f32 r0 = d0 * d0 * (tw * tw + th * th) + (d0 - zc) * (d0 - zc);
+        f32 r1 = d1 * d1 * (tw * tw + th * th) + (d1 - zc) * (d1 - zc);
+        f32 radius = ceilf(sqrtf(r0 > r1 ? r0 : r1));
+        Vec3 center = cam.getPosition() + cam.getFront() * zc;
+
+        // the center is snapped to whole texels so the map does not
+        // shimmer, and does not change until the camera crosses a texel
+        f32 texel = 2 * radius / c.size;
+        Vec4 ls = basis * Vec4(center);
+        ls.x = roundf(ls.x / texel) * texel;
+        ls.y = roundf(ls.y / texel) * texel;
+        ls.z = roundf(ls.z / texel) * texel;
+        Vec3 origin = Vec3(basis[0]) * ls.x + Vec3(basis[1]) * ls.y + Vec3(basis[2]) * ls.z;
+
+        // casters reach up to the top of the world, anything in front of
+        // the near plane is clamped onto it by the depth shader
+        f32 depth = radius + CHUNK_MAX_Y;
+
+        bool changed = !m_caching || !c.valid || c.meshGeneration != meshGeneration ||
+                       c.radius != radius ||
+                       memcmp(&c.direction, &sunDirection, sizeof(Vec3)) ||
+                       memcmp(&c.origin, &origin, sizeof(Vec3));
+        bool due = !c.valid || m_frame % m_config.interval[i] == i % m_config.interval[i];
+        if (changed && due) {
+            c.viewProj = mat4Orthographic(radius, radius, depth) * mat4LookAt(origin, sunDirection, Vec3(0, 1, 0));
+            c.split = d1;
+            c.bias = BIAS_TEXELS * texel / (2 * depth);
+            c.direction = sunDirection;
+            c.origin = origin;
+            c.radius = radius;
+            c.meshGeneration = meshGeneration;
+            c.valid = true;
+            c.pending = true;
+        }
+        d0 = d1;
+    }
+}
+
+void ShadowCascades::render(World &world, const Shader &depthShader)
+{
+    bool any = false;
+    for (u32 i = 0; i < m_config.count; i ++)
+        any = any || m_cascades[i].pending;
+    if (!any)
+        return;
+
+    depthShader.bind();
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    for (u32 i = 0; i < m_config.count; i ++) {
+        ShadowCascade &c = m_cascades[i];
+        if (!c.pending)
+            continue;
+        m_map.prepWrite(c.x, c.y, c.size, c.size);
+        depthShader.uniform("cascade", (i32)i);
+        world.depthPass(depthShader, c.viewProj);
+        c.cull = world.getDepthCullStats();
+        c.redraws ++;
+        c.pending = false;
+    }
+    glDisable(GL_POLYGON_OFFSET_FILL);
+}
+
+void ShadowCascades::setFrameUniforms(FrameUniforms &frame) const
+{
+    f32 w = (f32)m_map.getWidth(), h = (f32)m_map.getHeight();
+    frame.cascadeCount = (i32)m_config.count;
+    for (u32 i = 0; i < m_config.count; i ++) {
+        const ShadowCascade &c = m_cascades[i];
+        frame.cascadeViewProj[i] = c.viewProj;
+        frame.cascadeRects[i] = Vec4(c.x / w, c.y / h, c.size / w, c.size / h);
+        frame.cascadeSplits[i] = c.split;
+        frame.cascadeBias[i] = c.bias;
+    }
+}
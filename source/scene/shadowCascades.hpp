@@ -0,0 +1,73 @@
+#pragma once
+
+#include "rendering/shadowMap.hpp"
+#include "scene/camera.hpp"
+#include "scene/frameUniforms.hpp"
+#include "world/world.hpp"
+
+class Shader;
+
+struct ShadowConfig {
+    u32 count;
+    u32 resolution[MAX_SHADOW_CASCADES]; // width and height of each cascade
+    u32 interval  [MAX_SHADOW_CASCADES]; // frames between redraws of each cascade
+    f32 lambda;                          // splits go from even at 0 to logarithmic at 1
+};
+
+struct ShadowCascade {
+    Mat4 viewProj;
+    i32 x, y, size;     // where the cascade is in the shadow map
+    f32 split, bias;
+
+    // what the cascade was last drawn from
+    Vec3 direction;
+    Vec3 origin;
+    f32 radius;
+    u32 meshGeneration;
+    bool valid;
+
+    bool pending;       // drawn on the next render
+    u32 redraws;
+    CullStats cull;
+};
+
+// splits the view into slices that each get an orthographic shadow map of
+// their own, fit tightly around the slice. the maps share one depth texture
+// and the block shader picks the slice by view depth. a cascade is only
+// drawn again when the sun, its snapped position or the chunk meshes
+// changed, and never more often than its interval allows
+class ShadowCascades {
+public:
+    ShadowCascades(u32 unit, const ShadowConfig &config);
+
+    // fits the cascades to the camera and picks the ones to draw
+    void update(const Camera &cam, const Vec3 &sunDirection, u32 meshGeneration, f32 deltaTime);
+    void render(World &world, const Shader &depthShader);
+    void setFrameUniforms(FrameUniforms &frame) const;
+
+    // without caching every cascade is drawn each time its interval comes up
+    void setCaching(bool caching);
+    inline bool getCaching() const { return m_caching; }
+
+    inline u32 getTextureUnit() const { return m_map.getTextureUnit(); }
+    inline u32 getCount() const { return m_config.count; }
+    inline const ShadowCascade &getCascade(u32 i) const { return m_cascades[i]; }
+
+    // how often a cascade was drawn since caching last changed
+    f32 getRedrawsPerMinute(u32 i) const;
+
+private:
+    ShadowConfig m_config;
+    ShadowCascade m_cascades[MAX_SHADOW_CASCADES];
+    ShadowMap m_map;
+    bool m_caching;
+    u32 m_frame;
+    f32 m_time; // ms the redraws were counted over
+
+    /// <summary>
+    /// Packs the cascades into one map, the first on the left and the rest
+    /// on shelves as wide as the first to its right, and creates a map of
+    /// the size that takes
+    /// </summary>
+    static ShadowMap _createMap(u32 unit, const ShadowConfig &config, ShadowCascade *cascades);
+};
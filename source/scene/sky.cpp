@@ -1,6 +1,6 @@
 #include "scene/sky.hpp"
 #include "glad/glad.h"
-#include "world/chunk.hpp"
+#include "utility/assets.hpp"
 
 static constexpr f32 sunVertices[] = {
      1.0f, -0.1f, -0.1f,  1.0f, -0.1f,  0.1f,  1.0f,  0.1f,  0.1f,
@@ -27,23 +27,39 @@ static constexpr f32 skyboxVertices[] = {
      1.0f, -1.0f, -1.0f, -1.0f, -1.0f,  1.0f,  1.0f, -1.0f,  1.0f,
 };
 
-Sky::Sky(const Vec3 &pos) :
+#define SUN_VERTEX_SHADER      "../shaders/sun.v.glsl"
+#define SUN_FRAGMENT_SHADER    "../shaders/sun.f.glsl"
+#define SKYBOX_VERTEX_SHADER   "../shaders/skybox.v.glsl"
+#define SKYBOX_FRAGMENT_SHADER "../shaders/skybox.f.glsl"
+
+static const Cubemap::Paths skyboxFaces = {{
+    "../resources/skybox/right.png",
+    "../resources/skybox/left.png",
+    "../resources/skybox/top.png",
+    "../resources/skybox/bottom.png",
+    "../resources/skybox/front.png",
+    "../resources/skybox/back.png",
+}};
+
+void Sky::queueAssets()
+{
+    Assets::queueText(SUN_VERTEX_SHADER);
+    Assets::queueText(SUN_FRAGMENT_SHADER);
+    Assets::queueText(SKYBOX_VERTEX_SHADER);
+    Assets::queueText(SKYBOX_FRAGMENT_SHADER);
+    for (const char *path : skyboxFaces.paths)
+        Assets::queueImage(path);
+}
+
+Sky::Sky() :
     m_sun {
         VertexArray(STATIC),
-        ShadowMap(1, 4096, 4096),
-        Shader("../shaders/sun.v.glsl", "../shaders/sun.f.glsl"),
+        Shader(SUN_VERTEX_SHADER, SUN_FRAGMENT_SHADER),
     },
     m_skybox {
         VertexArray(STATIC),
-        Shader("../shaders/skybox.v.glsl", "../shaders/skybox.f.glsl"),
-        Cubemap(3, {
-                "../resources/skybox/right.png",
-                "../resources/skybox/left.png",
-                "../resources/skybox/top.png",
-                "../resources/skybox/bottom.png",
-                "../resources/skybox/front.png",
-                "../resources/skybox/back.png",
-            }),
+        Shader(SKYBOX_VERTEX_SHADER, SKYBOX_FRAGMENT_SHADER),
+        Cubemap(3, skyboxFaces),
     }
 {
     m_skybox.vao.bind();
@@ -52,27 +68,24 @@ Sky::Sky(const Vec3 &pos) :
     VertexAttrib va = {0, 3, FLOAT};
     m_skybox.vao.setAttribs(1, &va);
 
-    m_sun.proj = mat4Orthographic(240, 240, 256);
     m_sun.direction = Vec3(-1.0f,  0.0f,  0.0f);
 
     const Mat4 rot  = mat4RotationZ(DEG2RAD(m_sun.angle));
     m_sun.direction = Vec3(rot * Vec4(m_sun.direction));
 
-    Vec3 dir = normalize(m_sun.direction);
-    Vec3 src = pos;
-    src.y = CHUNK_MAX_Y / 2.0f;
-    m_sun.view = mat4LookAt(src, dir, Vec3(0, 1, 0));
-    m_sun.direction = dir;
+    m_sun.direction = normalize(m_sun.direction);
 
     m_skybox.shader.bind();
     m_skybox.shader.uniform("skybox", m_skybox.cubemap.getTextureUnit());
+    m_skybox.shader.uniformBlock("Frame", FRAME_UNIFORM_BINDING);
+    m_sun.shader.uniformBlock("Frame", FRAME_UNIFORM_BINDING);
 
     m_sun.vao.bind();
     m_sun.vao.setData(sizeof(sunVertices), (void *)sunVertices);
     m_sun.vao.setAttribs(1, &va);
 }
 
-void Sky::update(const Camera &camera, f32 deltaTime)
+void Sky::update(f32 deltaTime)
 {
     f32 deltaAngle = 0.00125f * deltaTime;
 
@@ -87,21 +100,6 @@ void Sky::update(const Camera &camera, f32 deltaTime)
     m_skybox.angle += deltaAngle;
     accum += deltaAngle;
 
-    Vec3 dir = m_sun.direction;
-    Vec4 src = Vec4(camera.getPosition());
-    src.y = CHUNK_MAX_Y / 2.0f;
-
-    Mat4 sunViewProj = m_sun.proj * m_sun.view;
-    src = sunViewProj * src;
-    src = src / src.w * 0.5f + Vec4(0.5f);
-    src.x = roundf(src.x * m_sun.shadowMap.getWidth ()) / m_sun.shadowMap.getWidth ();
-    src.y = roundf(src.y * m_sun.shadowMap.getHeight()) / m_sun.shadowMap.getHeight();
-    src = src * 2.0f - Vec4(1.0f);
-
-    Mat4 invSunViewProj = mat4Inverse(sunViewProj);
-    src = invSunViewProj * Vec4(src);
-    m_sun.view = mat4LookAt(Vec3(src), dir, Vec3(0, 1, 0));
-
     f32 diff;
     if (m_sun.angle < 45.0f)       diff = lerp(0.2f, 0.4f, (m_sun.angle -   0.0f) / ( 45.0f -   0.0f));
     else if (m_sun.angle <  75.0f) diff = lerp(0.4f, 0.6f, (m_sun.angle -  45.0f) / ( 75.0f -  45.0f));
@@ -117,7 +115,7 @@ void Sky::update(const Camera &camera, f32 deltaTime)
     m_sun.ambient = Vec3(1.1f, 1.0f, 0.9f) * max(diff, 0.2f);
 }
 
-void Sky::render(const Camera &camera)
+void Sky::setFrameUniforms(const Camera &camera, FrameUniforms &frame) const
 {
     Mat4 view = camera.getViewMatrix();
     view[0][3] = 0;
@@ -125,21 +123,24 @@ void Sky::render(const Camera &camera)
     view[2][3] = 0;
     Mat4 proj = camera.getProjectionMatrix();
     Mat4 viewproj = proj * view;
-    Mat4 modelviewproj = viewproj * mat4RotationZ(DEG2RAD(m_sun.angle));
-    Vec3 sunPos = -m_sun.direction;
 
+    frame.sunModelViewProj = viewproj * mat4RotationZ(DEG2RAD(m_sun.angle));
+    frame.skyModelViewProj = viewproj * mat4RotationY(DEG2RAD(m_skybox.angle));
+    frame.sunDirection     = Vec4(m_sun.direction);
+    frame.sunAmbient       = Vec4(m_sun.ambient);
+    frame.sunDiffuse       = Vec4(m_sun.diffuse);
+}
+
+void Sky::render()
+{
     glDepthRange(0.9999f, 1.0f);
 
     m_sun.shader.bind();
-    m_sun.shader.uniform("modelviewproj", modelviewproj);
-    m_sun.shader.uniform("sunPos", sunPos);
     m_sun.vao.bind();
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
-    modelviewproj = viewproj * mat4RotationY(DEG2RAD(m_skybox.angle));
     m_skybox.vao.bind();
     m_skybox.shader.bind();
-    m_skybox.shader.uniform("modelviewproj", modelviewproj);
     glDrawArrays(GL_TRIANGLES, 0, 36);
 
     glDepthRange(0.0f, 1.0f);
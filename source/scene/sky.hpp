@@ -1,17 +1,14 @@
 #pragma once
 
 #include "rendering/vertexArray.hpp"
-#include "rendering/shadowMap.hpp"
 #include "rendering/shader.hpp"
 #include "rendering/cubemap.hpp"
 #include "scene/camera.hpp"
+#include "scene/frameUniforms.hpp"
 
 struct Sun {
     VertexArray vao;
-    ShadowMap shadowMap;
     Shader shader;
-    Mat4 view      = Mat4();
-    Mat4 proj      = Mat4();
     Vec3 direction = Vec3();
     Vec3 ambient   = Vec3();
     Vec3 diffuse   = Vec3();
@@ -27,10 +24,16 @@ struct SkyBox {
 
 class Sky {
 public:
-    Sky(const Vec3 &pos);
+    Sky();
 
-    void update(const Camera &cam, f32 dt);
-    void render(const Camera &cam);
+    // starts loading the files the sky is made from
+    static void queueAssets();
+
+    void update(f32 dt);
+    void render();
+
+    // writes the sun and the sky for this frame into frame
+    void setFrameUniforms(const Camera &cam, FrameUniforms &frame) const;
     inline const Sun &getSun() { return m_sun; }
     inline const SkyBox &getSkybox() { return m_skybox; }
 
@@ -0,0 +1,141 @@
+#include "assets.hpp"
+#include "png.hpp"
+#include "threadPool.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Assets {
+    struct Entry {
+        bool done;
+        bool isImage;
+        u32 levels;
+        Image image;
+        MappedFile text;
+        const char *error;
+    };
+
+    static ThreadPool *pool = nullptr;
+    static std::mutex mutex;
+    static std::condition_variable loaded;
+    static std::unordered_map<std::string, Entry> entries;
+
+    static void _submit(ThreadPool::Job job);
+    static void _queue(const char *path, bool isImage, u32 levels);
+    static bool _take(const char *path, Entry &e);
+}
+
+void Assets::_submit(ThreadPool::Job job)
+{
+    if (!pool)
+        pool = new ThreadPool();
+    pool->submit(std::move(job));
+}
+
+void Assets::_queue(const char *path, bool isImage, u32 levels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.count(path))
+        return;
+    Entry &e = entries[path];
+    e = {};
+    e.isImage = isImage;
+    e.levels = levels;
+
+    std::string p = path;
+    _submit([p, isImage, levels](u32) {
+        Entry r = {};
+        r.done = true;
+        r.isImage = isImage;
+        r.levels = levels;
+        if (isImage) {
+            if (!openImage(p.c_str(), levels, &r.image))
+                r.error = getPNGError();
+        } else {
+            if (!r.text.open(p.c_str()))
+                r.error = "failed to open file";
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries[p] = std::move(r);
+        }
+        loaded.notify_all();
+    });
+}
+
+bool Assets::_take(const char *path, Entry &e)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = entries.find(path);
+    if (it == entries.end())
+        return false;
+    loaded.wait(lock, [&it] { return it->second.done; });
+    e = std::move(it->second);
+    entries.erase(it);
+    return true;
+}
+
+void Assets::queueImage(const char *path, u32 levels)
+{
+    _queue(path, true, levels);
+}
+
+void Assets::queueText(const char *path)
+{
+    _queue(path, false, 0);
+}
+
+Image Assets::takeImage(const char *path, u32 levels)
+{
+    Entry e = {};
+    if (!_take(path, e)) {
+        if (!openImage(path, levels, &e.image))
+            e.error = getPNGError();
+    } else {
+        ASSERT(e.isImage && e.levels == levels, "image taken as something else than it was queued");
+    }
+    if (e.error)
+        die("while loading %s:\n%s", path, e.error);
+
+    // the caller streams an image that missed the cache, the cache for the
+    // next run is decoded again behind it
+    if (e.image.decoder) {
+        std::string p = path;
+        _submit([p, levels](u32) {
+            Image img;
+            if (loadImage(p.c_str(), levels, &img))
+                freeImage(img);
+        });
+    }
+    return e.image;
+}
+
+MappedFile Assets::takeText(const char *path)
+{
+    Entry e = {};
+    if (!_take(path, e)) {
+        if (!e.text.open(path))
+            e.error = "failed to open file";
+    }
+    ASSERT(!e.isImage, "image taken as text");
+    if (e.error)
+        die("while loading %s:\n%s", path, e.error);
+    return std::move(e.text);
+}
+
+void Assets::release()
+{
+    if (pool) {
+        pool->wait();
+        delete pool;
+        pool = nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &it : entries) {
+        freeImage(it.second.image);
+    }
+    entries.clear();
+}
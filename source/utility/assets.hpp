@@ -0,0 +1,22 @@
+#pragma once
+
+#include "utility/common.hpp"
+#include "utility/image.hpp"
+
+// files are read and images decoded on worker threads while the window and
+// the GL context come up, the GL objects then take them by path on the
+// render thread. anything that was not queued is loaded on the spot
+namespace Assets {
+    void queueImage(const char *path, u32 levels = 1);
+    void queueText (const char *path);
+
+    // waits for the file if it is still loading, images go back through
+    // freeImage once uploaded. an image that missed its cache comes with an
+    // open decoder instead of pixels. a failed load is fatal
+    Image      takeImage(const char *path, u32 levels = 1);
+    MappedFile takeText (const char *path);
+
+    // waits for every queued file and cache write, and frees the files
+    // nobody took. called at exit so the writes never hold up a frame
+    void release();
+};
@@ -1,5 +1,16 @@
 #include "common.hpp"
 #include <stdio.h>
+#include <stdint.h>
+
+#if PLATFORM_WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 void die(const char *fmt, ...) {
     va_list va;
@@ -10,25 +21,141 @@ void die(const char *fmt, ...) {
     exit(1);
 }
 
+// 64 bit offsets, so files past 2 GB get their real size
+static i64 fileSize(FILE *fp)
+{
+#if PLATFORM_WIN32
+    if (_fseeki64(fp, 0, SEEK_END) != 0) return -1;
+    i64 sz = _ftelli64(fp);
+    _fseeki64(fp, 0, SEEK_SET);
+#else
+    if (fseeko(fp, 0, SEEK_END) != 0) return -1;
+    i64 sz = ftello(fp);
+    fseeko(fp, 0, SEEK_SET);
+#endif
+    return sz;
+}
+
 u8 *readEntireFile(const char *fileName, size_t *size)
 {
     *size = 0;
     u8 * bf = nullptr;
     FILE *fp = fopen(fileName, "rb");
     if (!fp) { return nullptr; }
-    fseek(fp, 0, SEEK_END);
-    i32 sz = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    if (sz == -1) {
+    i64 sz = fileSize(fp);
+    if (sz < 0 || (u64)sz >= SIZE_MAX) {
         fclose(fp);
         return nullptr;
     }
-    bf = (u8*)calloc(sz + 1, 1);
+    bf = (u8*)calloc((size_t)sz + 1, 1);
     if (!bf) {
         fclose(fp);
         return nullptr;
     }
-    fread(bf, 1, sz, fp);
-    *size = sz;
+    size_t n = fread(bf, 1, (size_t)sz, fp);
+    fclose(fp);
+    if (n != (size_t)sz) {
+        free(bf);
+        return nullptr;
+    }
+    *size = (size_t)sz;
     return bf;
 }
+
+MappedFile::MappedFile() :
+    m_data(nullptr), m_size(0), m_mapped(false)
+{
+}
+
+MappedFile::MappedFile(const char *fileName) :
+    MappedFile()
+{
+    open(fileName);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) :
+    m_data(other.m_data), m_size(other.m_size), m_mapped(other.m_mapped)
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_mapped = false;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other)
+{
+    if (this != &other) {
+        close();
+        m_data = other.m_data;
+        m_size = other.m_size;
+        m_mapped = other.m_mapped;
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_mapped = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const char *fileName)
+{
+    close();
+#if PLATFORM_WIN32
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER sz;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &sz) && sz.QuadPart > 0 && (u64)sz.QuadPart <= SIZE_MAX)
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping) {
+            m_data = (u8 *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (m_data) {
+                m_size = (size_t)sz.QuadPart;
+                m_mapped = true;
+                return true;
+            }
+        }
+    }
+#else
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0 && (u64)st.st_size <= SIZE_MAX) {
+            void *view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                ::close(fd);
+                m_data = (u8 *)view;
+                m_size = (size_t)st.st_size;
+                m_mapped = true;
+                return true;
+            }
+        }
+        ::close(fd);
+    }
+#endif
+    // empty files, pipes and the like can not be mapped
+    m_data = readEntireFile(fileName, &m_size);
+    m_mapped = false;
+    return m_data != nullptr;
+}
+
+void MappedFile::close()
+{
+    if (!m_data)
+        return;
+#if PLATFORM_WIN32
+    if (m_mapped) UnmapViewOfFile(m_data);
+#else
+    if (m_mapped) munmap(m_data, m_size);
+#endif
+    if (!m_mapped) free(m_data);
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+}
@@ -26,6 +26,30 @@ typedef double f64;
 void die(const char *fmt, ...);
 u8* readEntireFile(const char *fileName, size_t *size);
 
+// a read only view of a whole file, mapped where the platform allows it and
+// read into memory otherwise. the view goes away with the object
+class MappedFile {
+public:
+     MappedFile();
+     MappedFile(const char *fileName);
+    ~MappedFile();
+    MappedFile(MappedFile &&other);
+    MappedFile &operator=(MappedFile &&other);
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const char *fileName);
+    void close();
+
+    inline bool isOpen() const { return m_data != nullptr; }
+    inline const u8 *getData() const { return m_data; }
+    inline size_t getSize() const { return m_size; }
+private:
+    u8 *m_data;
+    size_t m_size;
+    bool m_mapped;
+};
+
 #ifdef DEBUG
 #define ASSERT(_cond, _msg) assert((_cond) && (_msg))
 #else
@@ -0,0 +1,68 @@
+#include "cpu.hpp"
+
+#if CPU_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void cpuid(u32 leaf, u32 sub, u32 r[4])
+{
+#if defined(_MSC_VER)
+    __cpuidex((int *)r, leaf, sub);
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static u64 xgetbv(u32 index)
+{
+#if defined(_MSC_VER)
+    return _xgetbv(index);
+#else
+    u32 eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+    return ((u64)edx << 32) | eax;
+#endif
+}
+
+struct Features {
+    bool sse2, ssse3, avx2;
+
+    Features() : sse2(false), ssse3(false), avx2(false) {
+        u32 r[4];
+        cpuid(0, 0, r);
+        u32 maxLeaf = r[0];
+        if (maxLeaf < 1)
+            return;
+
+        cpuid(1, 0, r);
+        sse2  = (r[3] >> 26) & 1;
+        ssse3 = (r[2] >>  9) & 1;
+
+        // the os has to save ymm registers on context switches too
+        bool osxsave = (r[2] >> 27) & 1;
+        bool avx     = (r[2] >> 28) & 1;
+        if (!osxsave || !avx || maxLeaf < 7 || (xgetbv(0) & 6) != 6)
+            return;
+
+        cpuid(7, 0, r);
+        avx2 = (r[1] >> 5) & 1;
+    }
+};
+
+static const Features &features()
+{
+    static Features f;
+    return f;
+}
+
+bool cpuHasSSE2 () { return features().sse2 ; }
+bool cpuHasSSSE3() { return features().ssse3; }
+bool cpuHasAVX2 () { return features().avx2 ; }
+#else
+bool cpuHasSSE2 () { return false; }
+bool cpuHasSSSE3() { return false; }
+bool cpuHasAVX2 () { return false; }
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "common.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_X86 1
+#else
+#define CPU_X86 0
+#endif
+
+// functions using instructions above the compiler baseline are tagged with
+// these and only called after the matching runtime check
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+bool cpuHasSSE2();
+bool cpuHasSSSE3();
+bool cpuHasAVX2();
@@ -0,0 +1,208 @@
+#include "image.hpp"
+#include "png.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+
+#define CACHE_SUFFIX  ".texcache"
+#define CACHE_MAGIC   0x31435854 // "TXC1"
+#define CACHE_VERSION 1
+#define CACHE_ALIGN   16
+
+// followed by the source path and the levels, the levels start at the
+// first multiple of CACHE_ALIGN after the path
+struct CacheHeader {
+    u32 magic;
+    u32 version;
+    u64 sourceSize;
+    i64 sourceTime;
+    u32 width, height;
+    u32 levels;
+    u32 pathLength;
+};
+
+static u32 levelCount(u32 width, u32 height, u32 levels)
+{
+    u32 all = 1;
+    for (u32 m = width > height ? width : height; m > 1; m >>= 1)
+        all ++;
+    return levels == MIP_CHAIN || levels > all ? all : levels;
+}
+
+static size_t chainSize(u32 width, u32 height, u32 levels)
+{
+    Image img = {};
+    img.width = width, img.height = height;
+    size_t size = 0;
+    for (u32 i = 0; i < levels; i ++)
+        size += (size_t)4 * imageLevelWidth(img, i) * imageLevelHeight(img, i);
+    return size;
+}
+
+static size_t pixelOffset(u32 pathLength)
+{
+    size_t n = sizeof(CacheHeader) + pathLength;
+    return (n + CACHE_ALIGN - 1) & ~(size_t)(CACHE_ALIGN - 1);
+}
+
+// maps the cache file if it was made from the same source with the same
+// number of levels
+static bool loadCache(const std::string &cachePath, const char *path, const struct stat &st, u32 levels, Image *img)
+{
+    MappedFile *file = new MappedFile(cachePath.c_str());
+    if (!file->isOpen()) {
+        delete file;
+        return false;
+    }
+    const u8 *view = file->getData();
+    size_t size = file->getSize();
+
+    CacheHeader h;
+    u32 pathLength = (u32)strlen(path);
+    bool ok = size >= sizeof(h);
+    if (ok) {
+        memcpy(&h, view, sizeof(h));
+        ok = h.magic == CACHE_MAGIC && h.version == CACHE_VERSION &&
+             h.sourceSize == (u64)st.st_size && h.sourceTime == (i64)st.st_mtime &&
+             h.pathLength == pathLength && size >= sizeof(h) + pathLength &&
+             !memcmp(view + sizeof(h), path, pathLength) &&
+             h.levels == levelCount(h.width, h.height, levels) &&
+             size == pixelOffset(pathLength) + chainSize(h.width, h.height, h.levels);
+    }
+    if (!ok) {
+        delete file;
+        return false;
+    }
+
+    img->pixels = (u8 *)view + pixelOffset(pathLength);
+    img->width  = h.width;
+    img->height = h.height;
+    img->levels = h.levels;
+    img->mapping = file;
+    return true;
+}
+
+// the cache is only there to save time, failing to write it is not an error
+// it goes through a temporary file so a cut short write is never mapped
+static void writeCache(const std::string &cachePath, const char *path, const struct stat &st, const Image &img)
+{
+    CacheHeader h = {};
+    h.magic      = CACHE_MAGIC;
+    h.version    = CACHE_VERSION;
+    h.sourceSize = (u64)st.st_size;
+    h.sourceTime = (i64)st.st_mtime;
+    h.width      = img.width;
+    h.height     = img.height;
+    h.levels     = img.levels;
+    h.pathLength = (u32)strlen(path);
+
+    std::string tmpPath = cachePath + ".tmp";
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp)
+        return;
+    u8 pad[CACHE_ALIGN] = {};
+    size_t padding = pixelOffset(h.pathLength) - sizeof(h) - h.pathLength;
+    size_t size = chainSize(img.width, img.height, img.levels);
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+              fwrite(path, 1, h.pathLength, fp) == h.pathLength &&
+              fwrite(pad, 1, padding, fp) == padding &&
+              fwrite(img.pixels, 1, size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+
+    remove(cachePath.c_str());
+    if (!ok || rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+        remove(tmpPath.c_str());
+}
+
+// every level is a 2x2 box filter of the one above it, the last row and
+// column are repeated for odd sizes
+static void buildLevels(Image &img)
+{
+    u8 *src = img.pixels;
+    for (u32 i = 1; i < img.levels; i ++) {
+        u32 sw = imageLevelWidth(img, i - 1), sh = imageLevelHeight(img, i - 1);
+        u32 dw = imageLevelWidth(img, i),     dh = imageLevelHeight(img, i);
+        u8 *dst = src + (size_t)4 * sw * sh;
+        for (u32 y = 0; y < dh; y ++) {
+            const u8 *r0 = src + (size_t)4 * sw * (2 * y < sh ? 2 * y : sh - 1);
+            const u8 *r1 = src + (size_t)4 * sw * (2 * y + 1 < sh ? 2 * y + 1 : sh - 1);
+            u8 *out = dst + (size_t)4 * dw * y;
+            for (u32 x = 0; x < dw; x ++) {
+                u32 x0 = 4 * (2 * x < sw ? 2 * x : sw - 1);
+                u32 x1 = 4 * (2 * x + 1 < sw ? 2 * x + 1 : sw - 1);
+                for (u32 c = 0; c < 4; c ++)
+                    out[4 * x + c] = (u8)((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+            }
+        }
+        src = dst;
+    }
+}
+
+bool loadImage(const char *path, u32 levels, Image *img)
+{
+    *img = {};
+    std::string cachePath = std::string(path) + CACHE_SUFFIX;
+    struct stat st;
+    bool haveStat = stat(path, &st) == 0;
+    if (haveStat && loadCache(cachePath, path, st, levels, img))
+        return true;
+
+    PNGDecoder png;
+    if (!png.openFile(path))
+        return false;
+    img->width  = png.getWidth();
+    img->height = png.getHeight();
+    img->levels = levelCount(img->width, img->height, levels);
+    img->pixels = (u8 *)malloc(chainSize(img->width, img->height, img->levels));
+    if (!img->pixels)
+        die("out of memory");
+    if (!png.readRows(img->pixels, img->height, (size_t)4 * img->width)) {
+        free(img->pixels);
+        *img = {};
+        return false;
+    }
+
+    buildLevels(*img);
+    if (haveStat)
+        writeCache(cachePath, path, st, *img);
+    return true;
+}
+
+bool openImage(const char *path, u32 levels, Image *img)
+{
+    *img = {};
+    std::string cachePath = std::string(path) + CACHE_SUFFIX;
+    struct stat st;
+    if (stat(path, &st) == 0 && loadCache(cachePath, path, st, levels, img))
+        return true;
+
+    PNGDecoder *png = new PNGDecoder();
+    if (!png->openFile(path)) {
+        delete png;
+        return false;
+    }
+    img->width   = png->getWidth();
+    img->height  = png->getHeight();
+    img->levels  = 1;
+    img->decoder = png;
+    return true;
+}
+
+void freeImage(Image &img)
+{
+    if (img.decoder)
+        delete img.decoder;
+    else if (img.mapping)
+        delete img.mapping;
+    else
+        free(img.pixels);
+    img = {};
+}
+
+const u8 *imageLevel(const Image &img, u32 level)
+{
+    ASSERT(level < img.levels, "level out of range");
+    ASSERT(img.pixels, "image has not been decoded");
+    return img.pixels + chainSize(img.width, img.height, level);
+}
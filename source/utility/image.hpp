@@ -0,0 +1,36 @@
+#pragma once
+
+#include "utility/common.hpp"
+
+// asks for every level down to 1x1
+#define MIP_CHAIN 0
+
+class PNGDecoder;
+
+// an RGBA image and the levels below it, every level follows the one before
+// it in memory. the pixels are either allocated or a view of a mapped cache
+// file, or there are none yet and the rows are read from an open decoder.
+// freeImage takes care of all three
+struct Image {
+    u8 *pixels;
+    u32 width, height;
+    u32 levels;
+    MappedFile *mapping;
+    PNGDecoder *decoder;
+};
+
+// decodes the PNG at path into an image with the given number of levels,
+// the result is kept in a cache file next to it and mapped straight from
+// there while the PNG keeps its size and modification time
+// errors are reported through getPNGError
+bool loadImage(const char *path, u32 levels, Image *img);
+
+// maps the cache like loadImage, but when it is missing or stale the PNG is
+// left open on img.decoder with a single level and no pixels, so the caller
+// can stream the rows where they need to go. nothing is cached that way
+bool openImage(const char *path, u32 levels, Image *img);
+void freeImage(Image &img);
+
+inline u32 imageLevelWidth (const Image &img, u32 level) { u32 w = img.width  >> level; return w ? w : 1; }
+inline u32 imageLevelHeight(const Image &img, u32 level) { u32 h = img.height >> level; return h ? h : 1; }
+const u8 *imageLevel(const Image &img, u32 level);
@@ -1,6 +1,11 @@
 #include "noise.hpp"
+#include "cpu.hpp"
 #include <math.h>
 
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
 // *Really* minimal PCG32 code / (c) 2014 M.E. O'Neill / pcg-random.org
 // Licensed under Apache License 2.0 (NO WARRANTY, etc. see website)
 
@@ -124,3 +129,210 @@ f32 noise(f32 xin, f32 yin, u8 perm[512])
     return (70.0f * (n0 + n1 + n2));
 }
 
+//
+// batched noise, every kernel performs the same float operations in the
+// same order as noise() so the results match bit for bit
+//
+
+static const f32 F2 = 0.5f*(sqrtf(3.0f)-1.0f);
+static const f32 G2 = (3.0f-sqrtf(3.0f))/6.0f;
+
+static const f32 gradX[12] = { 1,-1, 1,-1, 1,-1, 1,-1, 0, 0, 0, 0};
+static const f32 gradY[12] = { 1, 1,-1,-1, 0, 0, 0, 0, 1,-1, 1,-1};
+
+typedef void (*NoiseKernel)(const f32 *x, const f32 *y, f32 *out, u32 count, const u8 *perm);
+
+static void noiseBatchScalar(const f32 *x, const f32 *y, f32 *out, u32 count, const u8 *perm)
+{
+    for (u32 i = 0; i < count; i ++)
+        out[i] = noise(x[i], y[i], (u8 *)perm);
+}
+
+#if CPU_X86
+static inline __m128i floorToInt(__m128 v)
+{
+    // truncation rounds negative values up, step those back down
+    __m128i t = _mm_cvttps_epi32(v);
+    __m128 tf = _mm_cvtepi32_ps(t);
+    return _mm_add_epi32(t, _mm_castps_si128(_mm_cmpgt_ps(tf, v)));
+}
+
+static inline __m128 corner(__m128 x, __m128 y, __m128 gx, __m128 gy)
+{
+    __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y));
+    __m128 inside = _mm_cmpge_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    __m128 n = _mm_mul_ps(_mm_mul_ps(t, t), _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y)));
+    return _mm_and_ps(inside, n);
+}
+
+static void noiseBatchSSE2(const f32 *xs, const f32 *ys, f32 *out, u32 count, const u8 *perm)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 f2  = _mm_set1_ps(F2);
+    const __m128 g2  = _mm_set1_ps(G2);
+    const __m128 g22 = _mm_set1_ps(2.0f * G2);
+
+    u32 k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 xin = _mm_loadu_ps(xs + k);
+        __m128 yin = _mm_loadu_ps(ys + k);
+        __m128 s = _mm_mul_ps(_mm_add_ps(xin, yin), f2);
+        __m128i i = floorToInt(_mm_add_ps(xin, s));
+        __m128i j = floorToInt(_mm_add_ps(yin, s));
+        __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), g2);
+        __m128 x0 = _mm_sub_ps(xin, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+        __m128 y0 = _mm_sub_ps(yin, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+
+        __m128 lower = _mm_cmpgt_ps(x0, y0);
+        __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_and_ps(lower, one)), g2);
+        __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_andnot_ps(lower, one)), g2);
+        __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), g22);
+        __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), g22);
+
+        // no gathers in SSE2, look the gradients up one lane at a time
+        alignas(16) i32 ii[4], jj[4], lw[4];
+        alignas(16) f32 gx[3][4], gy[3][4];
+        _mm_store_si128((__m128i *)ii, i);
+        _mm_store_si128((__m128i *)jj, j);
+        _mm_store_si128((__m128i *)lw, _mm_castps_si128(lower));
+        for (u32 l = 0; l < 4; l ++) {
+            i32 a = ii[l] & 255, b = jj[l] & 255;
+            i32 i1 = lw[l] & 1, j1 = 1 - i1;
+            i32 gi0 = perm[a+perm[b]] % 12;
+            i32 gi1 = perm[a+i1+perm[b+j1]] % 12;
+            i32 gi2 = perm[a+1+perm[b+1]] % 12;
+            gx[0][l] = gradX[gi0], gy[0][l] = gradY[gi0];
+            gx[1][l] = gradX[gi1], gy[1][l] = gradY[gi1];
+            gx[2][l] = gradX[gi2], gy[2][l] = gradY[gi2];
+        }
+
+        __m128 n0 = corner(x0, y0, _mm_load_ps(gx[0]), _mm_load_ps(gy[0]));
+        __m128 n1 = corner(x1, y1, _mm_load_ps(gx[1]), _mm_load_ps(gy[1]));
+        __m128 n2 = corner(x2, y2, _mm_load_ps(gx[2]), _mm_load_ps(gy[2]));
+        _mm_storeu_ps(out + k, _mm_mul_ps(_mm_set1_ps(70.0f), _mm_add_ps(_mm_add_ps(n0, n1), n2)));
+    }
+
+    noiseBatchScalar(xs + k, ys + k, out + k, count - k, perm);
+}
+
+TARGET_AVX2 static inline __m256 corner(__m256 x, __m256 y, __m256 gx, __m256 gy)
+{
+    __m256 t = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y));
+    __m256 inside = _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GE_OQ);
+    t = _mm256_mul_ps(t, t);
+    __m256 n = _mm256_mul_ps(_mm256_mul_ps(t, t), _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y)));
+    return _mm256_and_ps(inside, n);
+}
+
+TARGET_AVX2 static inline __m256i mod12(__m256i v)
+{
+    // v / 12 as a multiply and shift, exact for v < 512
+    __m256i q = _mm256_srli_epi32(_mm256_mullo_epi32(v, _mm256_set1_epi32(43691)), 19);
+    return _mm256_sub_epi32(v, _mm256_mullo_epi32(q, _mm256_set1_epi32(12)));
+}
+
+TARGET_AVX2 static void noiseBatchAVX2(const f32 *xs, const f32 *ys, f32 *out, u32 count, const u8 *perm)
+{
+    // gathers load 32 bits per lane, widen the table so they stay in bounds
+    alignas(32) i32 perm32[512];
+    for (u32 i = 0; i < 512; i ++)
+        perm32[i] = perm[i];
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 f2  = _mm256_set1_ps(F2);
+    const __m256 g2  = _mm256_set1_ps(G2);
+    const __m256 g22 = _mm256_set1_ps(2.0f * G2);
+    const __m256i m255 = _mm256_set1_epi32(255);
+    const __m256i ione = _mm256_set1_epi32(1);
+
+    u32 k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 xin = _mm256_loadu_ps(xs + k);
+        __m256 yin = _mm256_loadu_ps(ys + k);
+        __m256 s = _mm256_mul_ps(_mm256_add_ps(xin, yin), f2);
+        __m256i i = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(xin, s)));
+        __m256i j = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(yin, s)));
+        __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(i, j)), g2);
+        __m256 x0 = _mm256_sub_ps(xin, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+        __m256 y0 = _mm256_sub_ps(yin, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+
+        __m256 lower = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+        __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_and_ps(lower, one)), g2);
+        __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_andnot_ps(lower, one)), g2);
+        __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, one), g22);
+        __m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, one), g22);
+
+        __m256i ii = _mm256_and_si256(i, m255);
+        __m256i jj = _mm256_and_si256(j, m255);
+        __m256i i1 = _mm256_srli_epi32(_mm256_castps_si256(lower), 31);
+        __m256i j1 = _mm256_sub_epi32(ione, i1);
+
+        __m256i p0 = _mm256_i32gather_epi32(perm32, jj, 4);
+        __m256i p1 = _mm256_i32gather_epi32(perm32, _mm256_add_epi32(jj, j1), 4);
+        __m256i p2 = _mm256_i32gather_epi32(perm32, _mm256_add_epi32(jj, ione), 4);
+        __m256i gi0 = mod12(_mm256_i32gather_epi32(perm32, _mm256_add_epi32(ii, p0), 4));
+        __m256i gi1 = mod12(_mm256_i32gather_epi32(perm32, _mm256_add_epi32(_mm256_add_epi32(ii, i1), p1), 4));
+        __m256i gi2 = mod12(_mm256_i32gather_epi32(perm32, _mm256_add_epi32(_mm256_add_epi32(ii, ione), p2), 4));
+
+        __m256 n0 = corner(x0, y0, _mm256_i32gather_ps(gradX, gi0, 4), _mm256_i32gather_ps(gradY, gi0, 4));
+        __m256 n1 = corner(x1, y1, _mm256_i32gather_ps(gradX, gi1, 4), _mm256_i32gather_ps(gradY, gi1, 4));
+        __m256 n2 = corner(x2, y2, _mm256_i32gather_ps(gradX, gi2, 4), _mm256_i32gather_ps(gradY, gi2, 4));
+        _mm256_storeu_ps(out + k, _mm256_mul_ps(_mm256_set1_ps(70.0f), _mm256_add_ps(_mm256_add_ps(n0, n1), n2)));
+    }
+
+    noiseBatchScalar(xs + k, ys + k, out + k, count - k, perm);
+}
+#endif
+
+static NoiseKernel noiseKernel()
+{
+    static const NoiseKernel kernel =
+#if CPU_X86
+        cpuHasAVX2() ? noiseBatchAVX2 :
+        cpuHasSSE2() ? noiseBatchSSE2 :
+#endif
+        noiseBatchScalar;
+    return kernel;
+}
+
+void noiseBatch(const f32 *x, const f32 *y, f32 *out, u32 count, const u8 perm[512])
+{
+    noiseKernel()(x, y, out, count, perm);
+}
+
+void fbmBatch(const f32 *x, const f32 *y, f32 *out, u32 count, const FBMConfig &fc)
+{
+    constexpr u32 BATCH = 256;
+    f32 xs[BATCH], ys[BATCH], xf[BATCH], yf[BATCH], n[BATCH];
+    NoiseKernel kernel = noiseKernel();
+
+    for (u32 b = 0; b < count; b += BATCH) {
+        u32 m = count - b < BATCH ? count - b : BATCH;
+        for (u32 i = 0; i < m; i ++) {
+            xs[i] = x[b + i] / fc.scale;
+            ys[i] = y[b + i] / fc.scale;
+            out[b + i] = 0.0f;
+        }
+
+        f32 normalize = 0.0f;
+        f32 amplitude = 1.0f;
+        f32 frequency = 1.0f;
+
+        for (u32 o = 0; o < fc.octaves; o ++) {
+            for (u32 i = 0; i < m; i ++) {
+                xf[i] = xs[i] * frequency;
+                yf[i] = ys[i] * frequency;
+            }
+            kernel(xf, yf, n, m, fc.permutation);
+            for (u32 i = 0; i < m; i ++)
+                out[b + i] += amplitude * (n[i] * 0.5f + 0.5f);
+            normalize += amplitude;
+            amplitude *= fc.gain;
+            frequency *= fc.lacunarity;
+        }
+
+        for (u32 i = 0; i < m; i ++)
+            out[b + i] /= normalize;
+    }
+}
@@ -20,5 +20,10 @@ struct FBMConfig {
 f32 noise(f32 xin, f32 yin, u8 perm[512]);
 f32 fbm(f32 x, f32 y, FBMConfig &fc);
 
+// evaluate count samples at once, results are bit identical to noise()
+// and fbm() whichever of the scalar, SSE2 or AVX2 paths is picked
+void noiseBatch(const f32 *x, const f32 *y, f32 *out, u32 count, const u8 perm[512]);
+void fbmBatch(const f32 *x, const f32 *y, f32 *out, u32 count, const FBMConfig &fc);
+
 typedef struct pcg32_random_t { uint64_t state;  uint64_t inc; } pcg32_random_t;
 uint32_t pcg32_random_r(pcg32_random_t* rng);
\ No newline at end of file
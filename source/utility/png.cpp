@@ -1,11 +1,23 @@
 #include "png.hpp"
+#include "cpu.hpp"
 #include <memory.h>
+#include <utility>
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
 
 #define MAX_HLIT 289
 #define MAX_HDIST 32
 #define MAX_CODE_LENGTH 15
 
-static const char *errorStr = "";
+// codes up to HUFFMAN_FAST_BITS long are looked up with a single table
+// access, longer ones go through a second table for their first bits
+#define HUFFMAN_FAST_BITS 10
+#define HUFFMAN_FAST_MASK ((1u << HUFFMAN_FAST_BITS) - 1)
+#define HUFFMAN_TABLE_SIZE (2 << HUFFMAN_FAST_BITS)
+
+static thread_local const char *errorStr = "";
 const char *getPNGError() {return errorStr;}
 
 struct ByteBuffer
@@ -15,12 +27,11 @@ struct ByteBuffer
     size_t byteCount;
 };
 
+// entries are symbol << 16 | code length, or for the first bits of the
+// longer codes, sub table offset << 16 | sub table bits << 8
 struct Huffman
 {
-    u32 maxLen, symCount;
-    u32 *symbols;
-    u32 *lengths;
-    u32 *counts;
+    u32 table[HUFFMAN_TABLE_SIZE];
 };
 
 struct Chunk
@@ -29,6 +40,58 @@ struct Chunk
     ByteBuffer data;
 };
 
+// the zlib stream is read LSB first through a 64 bit buffer that is refilled
+// a word at a time, crossing into the following IDAT chunks as needed
+// past the last of them it is filled with zero bytes, counted in pad
+struct BitReader
+{
+    u64 bits;
+    u32 count;
+    u32 pad;
+    bool end;
+    const u8 *next;
+    size_t left;
+    ByteBuffer *file;
+};
+
+enum InflateState { INFLATE_BLOCK, INFLATE_STORED, INFLATE_HUFFMAN };
+
+// the inflated bytes go to a buffer that keeps the last WINDOW_SIZE of them
+// for back references, the bytes asked for are at most INFLATE_CHUNK and a
+// match may run MAX_MATCH past them. that is all the buffer holds, once a
+// request no longer fits after the window it slides back
+#define WINDOW_SIZE 32768
+#define MAX_MATCH 258
+#define INFLATE_CHUNK 16384
+#define INFLATE_BUFFER_SIZE (WINDOW_SIZE + INFLATE_CHUNK + MAX_MATCH)
+
+struct PNGStream
+{
+    ByteBuffer file;
+    BitReader br;
+    Huffman litlen, dist;
+    InflateState state;
+    bool final;
+    u32 storedLeft;
+
+    u32 bpp;
+    size_t rowBytes;     // the filter type and the filtered pixels of a row
+    size_t outPos;       // end of the inflated bytes
+    size_t outRead;      // end of the bytes handed out as rows
+    u8 *filtered;        // rows too long to be read from the window at once
+    u8 *prev;            // the last row handed out as RGBA
+    u8 *curr;            // the row being unfiltered
+    u8 window[INFLATE_BUFFER_SIZE];
+};
+
+enum FilterType { FILTER_NONE, FILTER_SUB, FILTER_UP, FILTER_AVERAGE, FILTER_PAETH };
+
+// unfilters pixels [start, width) of a row, out and prev are RGBA rows and
+// filt holds bpp bytes per pixel. 3 byte pixels get an alpha of 255, each
+// channel is predicted from its own lane so the alpha lane of prev never
+// leaks into the color channels
+typedef void (*UnfilterKernel)(u8 *out, const u8 *prev, const u8 *filt, u32 start, u32 width, u32 bpp, u32 type);
+
 typedef const void * Bytes;
 
 static u32    correctEndian(u32 a);
@@ -36,37 +99,140 @@ static Bytes  getBytes(ByteBuffer *lb, size_t n, size_t *r);
 static bool   getChunk(ByteBuffer *b, Chunk* c, u32 type);
 static bool   checkSignature(ByteBuffer *lb);
 #define       getType(lb, T, r) *(const T*)getBytes(lb, sizeof(T), r)
-static u32    idatGetBits(ByteBuffer *idat, size_t n, ByteBuffer *b);
-#define       idatGetType(lb, T, b, r) *(const T*)idatGetBytes(lb, sizeof(T), b, r)
-static size_t uncompressed(ByteBuffer *idat, ByteBuffer *b, size_t idx, u8 *decompData);
-static void   huffmanConstruct(Huffman *h);
-static i32    huffmanDecode(ByteBuffer *idat, ByteBuffer *b, Huffman *h);
-static bool   fixedHuffman (u32 *litlendistLengths, Huffman *litlenHuffman, Huffman *distHuffman);
-static bool   dynamicHuffman(ByteBuffer *idat, ByteBuffer *b, u32 *litlendistLengths, Huffman *litlenHuffman, Huffman *distHuffman);
-static size_t decompressUsingHuffman(u8 *decompData, ByteBuffer *idat, ByteBuffer *b, size_t idx, Huffman *litlenHuffman, Huffman *distHuffman);
-static bool   reverseFilter(u8 *pixels, u8 *decomData, u32 bpp, u32 width, u32 height);
+static void   bitRefillSlow(BitReader *br);
+static bool   huffmanConstruct(Huffman *h, const u32 *lengths, u32 symCount);
+static bool   fixedHuffman (Huffman *litlenHuffman, Huffman *distHuffman);
+static bool   dynamicHuffman(BitReader *br, Huffman *litlenHuffman, Huffman *distHuffman);
+static bool   inflate(PNGStream *s, size_t want);
+static bool   inflateStored(PNGStream *s);
+static bool   inflateHuffman(PNGStream *s, size_t want);
+static void   slideWindow(PNGStream *s);
+static const u8 *nextRow(PNGStream *s);
+static UnfilterKernel unfilterKernel();
 static u8     paethPredictor(i16 a, i16 b, i16 c);
 
+static inline u64 loadLE64(const u8 *p)
+{
+    return (u64)p[0]       | (u64)p[1] <<  8 | (u64)p[2] << 16 | (u64)p[3] << 24 |
+           (u64)p[4] << 32 | (u64)p[5] << 40 | (u64)p[6] << 48 | (u64)p[7] << 56;
+}
+
+// leaves at least 56 bits in the buffer
+static inline void bitRefill(BitReader *br)
+{
+    if (br->left < 8) {
+        bitRefillSlow(br);
+        return;
+    }
+    br->bits  |= loadLE64(br->next) << br->count;
+    br->next  += (63 - br->count) >> 3;
+    br->left  -= (63 - br->count) >> 3;
+    br->count |= 56;
+}
+
+static inline void bitDrop(BitReader *br, u32 n)
+{
+    br->bits >>= n;
+    br->count -= n;
+}
+
+static inline u32 bitGet(BitReader *br, u32 n)
+{
+    ASSERT(n <= 32, "getting too many bits");
+    if (br->count < n)
+        bitRefill(br);
+    u32 r = (u32)(br->bits & ((1ull << n) - 1));
+    bitDrop(br, n);
+    return r;
+}
+
+// needs at least MAX_CODE_LENGTH bits in the buffer
+static inline i32 huffmanDecode(BitReader *br, const Huffman *h)
+{
+    u32 e = h->table[br->bits & HUFFMAN_FAST_MASK];
+    u32 sub = (e >> 8) & 0xff;
+    if (sub)
+        e = h->table[(e >> 16) + ((br->bits >> HUFFMAN_FAST_BITS) & ((1u << sub) - 1))];
+    u32 len = e & 0xff;
+    if (!len)
+        return -1;
+    bitDrop(br, len);
+    return e >> 16;
+}
+
+// bits read past the end of the IDAT chunks
+static inline bool bitOverrun(const BitReader *br)
+{
+    return br->count < br->pad * 8;
+}
+
 //
 //
 //
 
 u8 *loadPNGFromFile(const char *fileName, u32 *w, u32 *h)
 {
-    size_t size = 0;
-    u8 *buffer = readEntireFile(fileName, &size);
-    if (!buffer) {
+    MappedFile file(fileName);
+    if (!file.isOpen()) {
+        *w = 0, *h = 0;
         errorStr = "failed to open file";
         return nullptr;
     }
-    u8 *ret = loadPNGFromMemory(buffer, size, w, h);
-    free(buffer);
-    return ret;
+    return loadPNGFromMemory(file.getData(), file.getSize(), w, h);
 }
 
 u8 *loadPNGFromMemory(const u8 *buffer, size_t size, u32 *w, u32 *h)
 {
     *w = 0, *h = 0;
+    PNGDecoder decoder;
+    if (!decoder.open(buffer, size))
+        return nullptr;
+
+    u32 width = decoder.getWidth(), height = decoder.getHeight();
+    u8 *pixels = (u8 *)malloc((size_t)4 * width * height);
+    if (!pixels) {
+        errorStr = "out of memory";
+        return nullptr;
+    }
+
+    if (!decoder.readRows(pixels, height, (size_t)4 * width)) {
+        free(pixels);
+        return nullptr;
+    }
+
+    *w = width, *h = height;
+    return pixels;
+}
+
+PNGDecoder::PNGDecoder()
+{
+    m_stream = nullptr;
+    m_width = m_height = 0;
+    m_row = 0;
+}
+
+PNGDecoder::~PNGDecoder()
+{
+    _close();
+}
+
+bool PNGDecoder::openFile(const char *fileName)
+{
+    _close();
+    MappedFile file(fileName);
+    if (!file.isOpen()) {
+        errorStr = "failed to open file";
+        return false;
+    }
+    if (!open(file.getData(), file.getSize()))
+        return false;
+    m_file = std::move(file);
+    return true;
+}
+
+bool PNGDecoder::open(const u8 *buffer, size_t size)
+{
+    _close();
     ByteBuffer bbuf;
     bbuf.bytes = (u8 *)buffer;
     bbuf.byteCount = size;
@@ -74,14 +240,14 @@ u8 *loadPNGFromMemory(const u8 *buffer, size_t size, u32 *w, u32 *h)
 
     if (!checkSignature(&bbuf)) {
         errorStr = "not a PNG file, PNG signature not found";
-        return nullptr;
+        return false;
     }
 
     size_t r;
     Chunk chunk;
     if (!getChunk(&bbuf, &chunk, *(u32*)"IHDR")) {
         errorStr = "corrupt PNG, IHDR chunk is not first";
-        return nullptr;
+        return false;
     }
 
     struct {
@@ -100,7 +266,8 @@ u8 *loadPNGFromMemory(const u8 *buffer, size_t size, u32 *w, u32 *h)
     ihdr.filtMethod = getType(&chunk.data, u8, &r);
     ihdr.laceMethod = getType(&chunk.data, u8, &r);
 
-#define EASSERT(cond, err) if (!(cond)) {errorStr = err; return nullptr;}
+#define EASSERT(cond, err) if (!(cond)) {errorStr = err; return false;}
+    EASSERT(ihdr.w && ihdr.h, "corrupt PNG, empty image");
     EASSERT(ihdr.bitDepth   == 8, "unsupported bit depth");
     EASSERT(ihdr.colorType  == 2 || ihdr.colorType == 6, "unsupported color type");
     EASSERT(ihdr.compMethod == 0, "unsupported compression method");
@@ -110,109 +277,99 @@ u8 *loadPNGFromMemory(const u8 *buffer, size_t size, u32 *w, u32 *h)
     while (chunk.type != *(u32*)"IDAT") {
         if (!getChunk(&bbuf, &chunk, 0)) {
             errorStr = "corrupt PNG, IDAT chunks missing";
-            return nullptr;
+            return false;
         }
     }
 
-    ByteBuffer idat = chunk.data;
-    u8 cmf = getType(&idat, u8, &r);
-    u8 flg = getType(&idat, u8, &r); (void)flg;
-    u8 cm  = (cmf & ((1 << 4) - 1));
-    EASSERT(cm == 8, "compression method must be 'deflate'");
-#undef EASSERT
-
-    size_t idx = 0;
-    u32 bpp = (ihdr.colorType == 2 ? 3 : 4);
-    u32 decompSize = ihdr.w * ihdr.h * bpp + ihdr.h;
-    u8 *decompData = (u8*)calloc(decompSize, 1);
-    if (!decompData) {
+    PNGStream *s = (PNGStream *)malloc(sizeof(PNGStream));
+    EASSERT(s, "out of memory");
+    m_stream = s;
+    m_width  = ihdr.w;
+    m_height = ihdr.h;
+    m_row    = 0;
+
+    s->file     = bbuf;
+    s->br       = {};
+    s->br.next  = chunk.data.bytes;
+    s->br.left  = chunk.data.byteCount;
+    s->br.file  = &s->file;
+    s->state    = INFLATE_BLOCK;
+    s->final    = false;
+    s->outPos   = s->outRead = 0;
+    s->bpp      = (ihdr.colorType == 2 ? 3 : 4);
+    s->rowBytes = (size_t)ihdr.w * s->bpp + 1;
+
+    // the row above the first one is all zeros
+    s->prev     = (u8 *)calloc(ihdr.w, 4);
+    s->curr     = (u8 *)malloc((size_t)ihdr.w * 4);
+    s->filtered = s->rowBytes > INFLATE_CHUNK ? (u8 *)malloc(s->rowBytes) : nullptr;
+    if (!s->prev || !s->curr || (s->rowBytes > INFLATE_CHUNK && !s->filtered)) {
+        _close();
         errorStr = "out of memory";
-        return nullptr;
+        return false;
     }
 
-    u32 litlendistLengths[MAX_HLIT + MAX_HDIST];
-    u32 litlenSymbols    [MAX_HLIT];
-    u32 litlenCounts     [MAX_CODE_LENGTH + 1];
-    u32 distSyms         [MAX_HDIST];
-    u32 distCounts       [MAX_CODE_LENGTH + 1];
-    memset(litlendistLengths, 0, sizeof(litlendistLengths));
-    memset(litlenSymbols    , 0, sizeof(litlenSymbols    ));
-    memset(litlenCounts     , 0, sizeof(litlenCounts     ));
-    memset(distSyms         , 0, sizeof(distSyms         ));
-    memset(distCounts       , 0, sizeof(distCounts       ));
-
-
-    Huffman litlenHuffman;
-    litlenHuffman.symbols = litlenSymbols;
-    litlenHuffman.counts  = litlenCounts;
-
-    Huffman distHuffman;
-    distHuffman.symbols = distSyms;
-    distHuffman.counts  = distCounts;
-
-    u32 bfinal, btype;
-    do {
-        bfinal = idatGetBits(&idat, 1, &bbuf);
-        btype  = idatGetBits(&idat, 2, &bbuf);
-
-        if (btype == 0) {
-            idx = uncompressed(&idat, &bbuf, idx, decompData);
-            if (!idx) {
-                free(decompData);
-                return nullptr;
-            }
-        }
-
-        if (btype == 3) {
-            errorStr = "corrupt PNG, bad BTYPE";
-            free(decompData);
-            return nullptr;
-        }
+    u8 cmf = (u8)bitGet(&s->br, 8);
+    u8 flg = (u8)bitGet(&s->br, 8); (void)flg;
+    u8 cm  = (cmf & ((1 << 4) - 1));
+    if (cm != 8) {
+        _close();
+        errorStr = "compression method must be 'deflate'";
+        return false;
+    }
+#undef EASSERT
+    return true;
+}
 
-        bool ok = (btype == 1) ?
-            fixedHuffman  (litlendistLengths, &litlenHuffman, &distHuffman) :
-            dynamicHuffman(&idat, &bbuf, litlendistLengths, &litlenHuffman, &distHuffman);
+bool PNGDecoder::readRows(u8 *dst, u32 count, size_t pitch)
+{
+    PNGStream *s = m_stream;
+    if (!s) {
+        errorStr = "no PNG open";
+        return false;
+    }
+    if (count > m_height - m_row) {
+        errorStr = "reading past the last row";
+        return false;
+    }
 
-        if (!ok) {
-            free(decompData);
-            return nullptr;
+    // rows are unfiltered in the stream's own two rows and only copied to
+    // dst, which is never read back as it may be write combined or mapped
+    // write only
+    ASSERT(pitch >= (size_t)4 * m_width, "rows overlap");
+    UnfilterKernel kernel = unfilterKernel();
+    for (u32 i = 0; i < count; i ++, dst += pitch) {
+        const u8 *row = nextRow(s);
+        if (!row) {
+            _close();
+            return false;
         }
-
-        huffmanConstruct(&litlenHuffman);
-        huffmanConstruct(&distHuffman);
-        idx = decompressUsingHuffman(decompData, &idat, &bbuf, idx, &litlenHuffman, &distHuffman);
-        if (!idx) {
-            free(decompData);
-            return nullptr;
+        u32 type = row[0];
+        if (type > FILTER_PAETH) {
+            errorStr = "corrupt PNG, invalid filter type";
+            _close();
+            return false;
         }
-    } while (!bfinal);
-
-    if (idat.bitCount != 8) {
-        idat.bytes     += 1;
-        idat.bitCount   = 8;
-        idat.byteCount -= 1;
+        kernel(s->curr, s->prev, row + 1, 0, m_width, s->bpp, type);
+        memcpy(dst, s->curr, (size_t)4 * m_width);
+        u8 *t = s->prev;
+        s->prev = s->curr;
+        s->curr = t;
     }
+    m_row += count;
+    return true;
+}
 
-    u32 alder32 = idatGetBits(&idat, 32, &bbuf); (void)alder32;
-    ASSERT(idat.bitCount == 0 && idat.byteCount == 1, "");
-    u8 *pixels = (u8 *)calloc(1, 4 * ihdr.w * ihdr.h);
-    if (!pixels) {
-        errorStr = "out of memory";
-        free(decompData);
-        return nullptr;
-    }
-    memset(pixels, 0xff, 4 * ihdr.w * ihdr.h);
-
-    if (!reverseFilter(pixels, decompData, bpp, ihdr.w, ihdr.h)) {
-        free(pixels);
-        free(decompData);
-        return nullptr;
+void PNGDecoder::_close()
+{
+    if (m_stream) {
+        free(m_stream->prev);
+        free(m_stream->curr);
+        free(m_stream->filtered);
+        free(m_stream);
+        m_stream = nullptr;
     }
-
-    free(decompData);
-
-    *w = ihdr.w, *h = ihdr.h;
-    return pixels;
+    m_file.close();
 }
 
 //
@@ -256,51 +413,237 @@ bool getChunk(ByteBuffer *b, Chunk* c, u32 type)
     return type == 0 || c->type == type;
 }
 
-size_t uncompressed(ByteBuffer *idat, ByteBuffer *b, size_t idx, u8 *decompData)
+void bitRefillSlow(BitReader *br)
 {
-    if (idat->byteCount > 0) {
-        idat->bytes ++;
-        idat->byteCount --;
-        idat->bitCount = 8;
-    } else {
-        idat->bytes     = nullptr;
-        idat->byteCount = 0;
-        idat->bitCount  = 0;
+    while (br->count < 56) {
+        if (!br->left && !br->end) {
+            Chunk chunk;
+            if (getChunk(br->file, &chunk, *(u32*)"IDAT")) {
+                br->next = chunk.data.bytes;
+                br->left = chunk.data.byteCount;
+                continue;
+            }
+            br->end = true;
+        }
+
+        if (br->left) {
+            br->bits |= (u64)*br->next++ << br->count;
+            br->left --;
+        } else {
+            br->pad ++;
+        }
+        br->count += 8;
     }
+}
 
-    size_t r;
-    u16 len = 0, nlen = 0;
-    len  |= idatGetBits(idat, 8, b) << 8;
-    len  |= idatGetBits(idat, 8, b) << 0;
-    nlen |= idatGetBits(idat, 8, b) << 8;
-    nlen |= idatGetBits(idat, 8, b) << 0;
-    if (len != (u16)~nlen) {
-        errorStr = "corrupt PNG, invalid LEN";
-        return 0;
-    }
-
-    while (len) {
-        Bytes dat = getBytes(idat, len, &r);
-        memcpy(decompData + idx, dat, len - r);
-        idx += len - r;
-        len = (u16)r;
-        if (len) {
+// inflates until want bytes past outRead are ready
+bool inflate(PNGStream *s, size_t want)
+{
+    BitReader *br = &s->br;
+    while (s->outPos - s->outRead < want) {
+        if (s->outPos + MAX_MATCH > INFLATE_BUFFER_SIZE)
+            slideWindow(s);
+
+        bool ok = true;
+        if (s->state == INFLATE_STORED) {
+            ok = inflateStored(s);
+        } else if (s->state == INFLATE_HUFFMAN) {
+            ok = inflateHuffman(s, want);
+        } else if (s->final) {
+            errorStr = "corrupt PNG, not enough image data";
+            ok = false;
+        } else {
+            s->final = bitGet(br, 1);
+            u32 btype = bitGet(br, 2);
+            if (btype == 0) {
+                bitDrop(br, br->count & 7);
+                u32 len  = bitGet(br, 16);
+                u32 nlen = bitGet(br, 16);
+                if (len != (~nlen & 0xffff)) {
+                    errorStr = "corrupt PNG, invalid LEN";
+                    ok = false;
+                }
+                s->storedLeft = len;
+                s->state = INFLATE_STORED;
+            } else if (btype == 3) {
+                errorStr = "corrupt PNG, bad BTYPE";
+                ok = false;
+            } else {
+                ok = (btype == 1) ?
+                    fixedHuffman  (&s->litlen, &s->dist) :
+                    dynamicHuffman(br, &s->litlen, &s->dist);
+                s->state = INFLATE_HUFFMAN;
+            }
+        }
+
+        if (ok && bitOverrun(br)) {
+            errorStr = "corrupt PNG, compressed data ends early";
+            ok = false;
+        }
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+// copies as much of a stored block as fits in the buffer
+bool inflateStored(PNGStream *s)
+{
+    BitReader *br = &s->br;
+    u8 *out = s->window + s->outPos;
+    u8 *end = s->window + INFLATE_BUFFER_SIZE;
+
+    // whatever is left in the bit buffer comes first, then the chunks
+    while (s->storedLeft && out < end && br->count >= 8) {
+        *out++ = (u8)bitGet(br, 8);
+        s->storedLeft --;
+    }
+
+    // the refill reads ahead of the bytes it counts, drop those bits as the
+    // data is no longer taken from the buffer
+    if (!br->count)
+        br->bits = 0;
+
+    while (s->storedLeft && out < end) {
+        if (!br->left) {
             Chunk chunk;
-            if (!getChunk(b, &chunk, *(u32*)"IDAT")) {
+            if (!getChunk(br->file, &chunk, *(u32*)"IDAT")) {
                 errorStr = "corrupt PNG, IDAT chunks missing or not consecutive";
-                return 0;
+                return false;
             }
+            br->next = chunk.data.bytes;
+            br->left = chunk.data.byteCount;
+            continue;
+        }
+        size_t n = s->storedLeft;
+        n = n < br->left ? n : br->left;
+        n = n < (size_t)(end - out) ? n : (size_t)(end - out);
+        memcpy(out, br->next, n);
+        out += n, s->storedLeft -= (u32)n;
+        br->next += n, br->left -= n;
+    }
+
+    s->outPos = out - s->window;
+    if (!s->storedLeft)
+        s->state = INFLATE_BLOCK;
+    return true;
+}
+
+// moves the last WINDOW_SIZE bytes back to the start of the buffer, the
+// bytes not read yet are always among them
+void slideWindow(PNGStream *s)
+{
+    ASSERT(s->outPos >= WINDOW_SIZE && s->outPos - s->outRead <= WINDOW_SIZE, "sliding too early");
+    size_t start = s->outPos - WINDOW_SIZE;
+    memmove(s->window, s->window + start, WINDOW_SIZE);
+    s->outPos  -= start;
+    s->outRead -= start;
+}
 
-            *idat = chunk.data;
+// the next row still filtered, valid until the following call
+const u8 *nextRow(PNGStream *s)
+{
+    if (!s->filtered) {
+        if (!inflate(s, s->rowBytes))
+            return nullptr;
+        const u8 *row = s->window + s->outRead;
+        s->outRead += s->rowBytes;
+        return row;
+    }
+
+    for (size_t n = 0; n < s->rowBytes;) {
+        size_t want = s->rowBytes - n;
+        want = want < INFLATE_CHUNK ? want : INFLATE_CHUNK;
+        if (!inflate(s, want))
+            return nullptr;
+        memcpy(s->filtered + n, s->window + s->outRead, want);
+        s->outRead += want;
+        n += want;
+    }
+    return s->filtered;
+}
+
+static u32 reverseBits(u32 code, u32 len)
+{
+    u32 r = 0;
+    for (u32 i = 0; i < len; i ++, code >>= 1)
+        r = (r << 1) | (code & 1);
+    return r;
+}
+
+bool huffmanConstruct(Huffman *h, const u32 *lengths, u32 symCount)
+{
+    u32 counts[MAX_CODE_LENGTH + 1] = {};
+    for (u32 i = 0; i < symCount; i ++)
+        counts[lengths[i]]++;
+    counts[0] = 0;
+
+    i32 left = 1;
+    for (u32 len = 1; len <= MAX_CODE_LENGTH; len ++) {
+        left = (left << 1) - counts[len];
+        if (left < 0) {
+            errorStr = "corrupt PNG, over-subscribed huffman code";
+            return false;
         }
     }
-    return idx;
+
+    // canonical codes, the first code of every length
+    u32 first[MAX_CODE_LENGTH + 1], next[MAX_CODE_LENGTH + 1];
+    u32 code = 0;
+    for (u32 len = 1; len <= MAX_CODE_LENGTH; len ++) {
+        code = (code + counts[len - 1]) << 1;
+        first[len] = next[len] = code;
+    }
+
+    memset(h->table, 0, sizeof(h->table));
+
+    // the codes are read starting from their first bit, which ends up as
+    // the lowest bit of the bit buffer, hence the tables are indexed by the
+    // reversed codes. every prefix of a longer code gets a sub table wide
+    // enough for the longest code below it
+    u8 subBits[1 << HUFFMAN_FAST_BITS] = {};
+    for (u32 i = 0; i < symCount; i ++) {
+        u32 len = lengths[i];
+        if (len <= HUFFMAN_FAST_BITS) continue;
+        u32 p = reverseBits(first[len]++, len) & HUFFMAN_FAST_MASK;
+        if (subBits[p] < len - HUFFMAN_FAST_BITS)
+            subBits[p] = (u8)(len - HUFFMAN_FAST_BITS);
+    }
+
+    u32 end = 1 << HUFFMAN_FAST_BITS;
+    for (u32 p = 0; p < (1u << HUFFMAN_FAST_BITS); p ++) {
+        if (!subBits[p]) continue;
+        if (end + (1u << subBits[p]) > HUFFMAN_TABLE_SIZE) {
+            errorStr = "corrupt PNG, huffman code too large";
+            return false;
+        }
+        h->table[p] = end << 16 | subBits[p] << 8;
+        end += 1 << subBits[p];
+    }
+
+    for (u32 i = 0; i < symCount; i ++) {
+        u32 len = lengths[i];
+        if (!len) continue;
+        u32 rev = reverseBits(next[len]++, len);
+        u32 e = i << 16 | len;
+        if (len <= HUFFMAN_FAST_BITS) {
+            for (u32 j = rev; j < (1u << HUFFMAN_FAST_BITS); j += 1 << len)
+                h->table[j] = e;
+        } else {
+            u32 link = h->table[rev & HUFFMAN_FAST_MASK];
+            u32 base = link >> 16, bits = (link >> 8) & 0xff;
+            for (u32 j = rev >> HUFFMAN_FAST_BITS; j < (1u << bits); j += 1 << (len - HUFFMAN_FAST_BITS))
+                h->table[base + j] = e;
+        }
+    }
+    return true;
 }
 
-bool fixedHuffman(u32 *litlendistLengths, Huffman *litlenHuffman, Huffman *distHuffman)
+bool fixedHuffman(Huffman *litlenHuffman, Huffman *distHuffman)
 {
 #define FIXED_MAX_LIT_VALUE 288
 #define FIXED_MAX_DIST_VALUE 32
+    u32 lengths[FIXED_MAX_LIT_VALUE + FIXED_MAX_DIST_VALUE];
     i32 i = 0;
     for (; i < FIXED_MAX_LIT_VALUE; i ++) {
         u32 v = 0;
@@ -308,201 +651,335 @@ bool fixedHuffman(u32 *litlendistLengths, Huffman *litlenHuffman, Huffman *distH
         else if (i <= 255) v = 9;
         else if (i <= 279) v = 7;
         else v = 8;
-        litlendistLengths[i] = v;
+        lengths[i] = v;
     }
 
     for (; i < FIXED_MAX_LIT_VALUE + FIXED_MAX_DIST_VALUE; i++)
-        litlendistLengths[i] = 5;
+        lengths[i] = 5;
 
-    litlenHuffman->lengths  = litlendistLengths;
-    litlenHuffman->symCount = FIXED_MAX_LIT_VALUE;
-    litlenHuffman->maxLen   = MAX_CODE_LENGTH;
-
-    distHuffman->lengths  = litlendistLengths + FIXED_MAX_LIT_VALUE;
-    distHuffman->symCount = FIXED_MAX_DIST_VALUE;
-    distHuffman->maxLen   = MAX_CODE_LENGTH;
-
-    return 1;
+    return huffmanConstruct(litlenHuffman, lengths, FIXED_MAX_LIT_VALUE) &&
+           huffmanConstruct(distHuffman, lengths + FIXED_MAX_LIT_VALUE, FIXED_MAX_DIST_VALUE);
 #undef FIXED_MAX_LIT_VALUE
 #undef FIXED_MAX_DIST_VALUE
 }
 
-bool dynamicHuffman(ByteBuffer *idat, ByteBuffer *b, u32 *litlendistLengths, Huffman *litlenHuffman, Huffman *distHuffman)
+bool dynamicHuffman(BitReader *br, Huffman *litlenHuffman, Huffman *distHuffman)
 {
 #define MAX_HCLEN 19
-#define MAX_CL_CODE_LENGTH 7
-    u32 hlit  = idatGetBits(idat, 5, b) + 257;
-    u32 hdist = idatGetBits(idat, 5, b) + 1;
-    u32 hclen = idatGetBits(idat, 4, b) + 4;
+    u32 hlit  = bitGet(br, 5) + 257;
+    u32 hdist = bitGet(br, 5) + 1;
+    u32 hclen = bitGet(br, 4) + 4;
 
     u8  order[MAX_HCLEN] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
-    u32 lengths[MAX_HCLEN], symbols[19], counts[MAX_CL_CODE_LENGTH + 1];
+    u32 lengths[MAX_HCLEN];
     memset(lengths, 0, sizeof(lengths));
 
     for (u32 i = 0; i < hclen; i ++)
-        lengths[order[i]] = idatGetBits(idat, 3, b);
+        lengths[order[i]] = bitGet(br, 3);
 
     Huffman codelenHuffman;
-    codelenHuffman.lengths  = lengths;
-    codelenHuffman.symbols  = symbols;
-    codelenHuffman.counts   = counts;
-    codelenHuffman.maxLen   = MAX_CL_CODE_LENGTH;
-    codelenHuffman.symCount = MAX_HCLEN;
-    huffmanConstruct(&codelenHuffman);
+    if (!huffmanConstruct(&codelenHuffman, lengths, MAX_HCLEN))
+        return false;
 
+    u32 litlendistLengths[MAX_HLIT + MAX_HDIST];
     u32 index = 0;
     while (index < hlit + hdist) {
-        i32 symbol = huffmanDecode(idat, b, &codelenHuffman);
+        bitRefill(br);
+        i32 symbol = huffmanDecode(br, &codelenHuffman);
         u32 rep = 0;
-        if (symbol <= 15) {
+        if (symbol < 0) {
+            errorStr = "corrupt PNG, bad code length code";
+            return false;
+        } else if (symbol <= 15) {
             rep = 1;
-        } else if (symbol == 16) {
+        } else if (symbol == 16 && index > 0) {
             symbol = litlendistLengths[index - 1];
-            rep = idatGetBits(idat, 2, b) + 3;
+            rep = bitGet(br, 2) + 3;
         } else if (symbol == 17) {
             symbol = 0;
-            rep = idatGetBits(idat, 3, b) + 3;
+            rep = bitGet(br, 3) + 3;
         } else if (symbol == 18) {
             symbol = 0;
-            rep = idatGetBits(idat, 7, b) + 11;
+            rep = bitGet(br, 7) + 11;
         } else {
             errorStr = "corrupt PNG, bad symbol while constructing dynamic huffman tree";
             return false;
         }
+        if (index + rep > hlit + hdist) {
+            errorStr = "corrupt PNG, too many code lengths";
+            return false;
+        }
         while (rep --)
             litlendistLengths[index ++] = symbol;
     }
 
-    litlenHuffman->lengths  = litlendistLengths;
-    litlenHuffman->maxLen   = MAX_CODE_LENGTH;
-    litlenHuffman->symCount = hlit;
-
-    distHuffman->lengths  = litlendistLengths + hlit;
-    distHuffman->maxLen   = MAX_CODE_LENGTH;
-    distHuffman->symCount = hdist;
-    return true;
+    return huffmanConstruct(litlenHuffman, litlendistLengths, hlit) &&
+           huffmanConstruct(distHuffman, litlendistLengths + hlit, hdist);
 #undef MAX_HCLEN
-#undef MAX_CL_CODE_LENGTH
 }
 
-size_t decompressUsingHuffman(u8 *decompData, ByteBuffer *idat, ByteBuffer *b, size_t idx, Huffman *litlenHuffman, Huffman *distHuffman)
+// decodes symbols until want bytes are ready, the block ends or the buffer
+// has no room left for another match
+bool inflateHuffman(PNGStream *s, size_t want)
 {
-    const u16  lenBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, };
-    const u8  lenExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, };
-    const u16 distBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, };
-    const u8 distExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, };
-
-    for (;;) {
-        /* decode literal/length value from input stream */
-        u32 value = huffmanDecode(idat, b, litlenHuffman);
+    static const u16  lenBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, };
+    static const u8  lenExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, };
+    static const u16 distBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, };
+    static const u8 distExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, };
+
+    // the bit reader and the position live in locals for the loop
+    BitReader br = s->br;
+    const Huffman *litlenHuffman = &s->litlen;
+    const Huffman *distHuffman = &s->dist;
+    u8 *window = s->window;
+    size_t idx = s->outPos;
+    size_t stop = s->outRead + want;
+    bool ok = true;
+
+    while (idx < stop && idx + MAX_MATCH <= INFLATE_BUFFER_SIZE) {
+        // a length code, its extra bits, a distance code and its extra
+        // bits add up to at most 48 bits, one refill covers all of them
+        bitRefill(&br);
+        i32 value = huffmanDecode(&br, litlenHuffman);
 
         if (value < 256) {
-            /* copy value (literal byte) to output stream */
-            decompData[idx++] = value;
+            if (value < 0) {
+                errorStr = "corrupt PNG, invalid code while decompressing";
+                ok = false;
+                break;
+            }
+            window[idx++] = (u8)value;
             continue;
         }
 
-        if (value == 256) /* end of block */
+        if (value == 256) { /* end of block */
+            s->state = INFLATE_BLOCK;
             break;
+        }
 
-        if(!(value >= 257 && value <= 285)) {
+        if (value > 285) {
             errorStr = "corrupt PNG, invalid length value while decompressing";
-            return 0;
+            ok = false;
+            break;
+        }
+
+        u32 lenIndex = value - 257;
+        u32 len = lenBase[lenIndex] + (u32)(br.bits & ((1u << lenExtra[lenIndex]) - 1));
+        bitDrop(&br, lenExtra[lenIndex]);
+
+        i32 distIndex = huffmanDecode(&br, distHuffman);
+        if (distIndex < 0 || distIndex >= 30) {
+            errorStr = "corrupt PNG, invalid distance while decompressing";
+            ok = false;
+            break;
+        }
+        u32 dist = distBase[distIndex] + (u32)(br.bits & ((1u << distExtra[distIndex]) - 1));
+        bitDrop(&br, distExtra[distIndex]);
+
+        if (dist > idx) {
+            errorStr = "corrupt PNG, invalid back reference";
+            ok = false;
+            break;
+        }
+
+        // overlapping copies repeat the bytes just written and have to go
+        // one byte at a time
+        u8 *dst = window + idx;
+        const u8 *src = dst - dist;
+        idx += len;
+        if (dist >= len) {
+            memcpy(dst, src, len);
+        } else {
+            while (len --)
+                *dst++ = *src++;
         }
+    }
+
+    s->br = br;
+    s->outPos = idx;
+    return ok;
+}
 
-        u16 lenIndex = value - 257;
-        u32 len = lenBase[lenIndex];
-        u8 extraBits = lenExtra[lenIndex];
-        len += idatGetBits(idat, extraBits, b);
-
-        /* decode distance from input stream */
-        u32 distIndex = huffmanDecode(idat, b, distHuffman);
-        u32 dist = distBase[distIndex];
-        extraBits = distExtra[distIndex];
-        dist += idatGetBits(idat, extraBits, b);
-
-        /* move backwards distance bytes in the output */
-        u8 *src = decompData + idx - dist;
-        while (len --) {
-            /* stream, and copy length bytes from this */
-            /* position to the output stream. */
-            decompData[idx++] = *src;
-            src++;
+static void unfilterScalar(u8 *out, const u8 *prev, const u8 *filt, u32 start, u32 width, u32 bpp, u32 type)
+{
+    for (u32 i = start; i < width; i ++) {
+        u8 *o = out + i * 4;
+        const u8 *b = prev + i * 4;
+        const u8 *f = filt + i * bpp;
+        for (u32 j = 0; j < bpp; j ++) {
+            u8 a = i ? (o - 4)[j] : 0;
+            u8 c = i ? (b - 4)[j] : 0;
+            u8 p = 0;
+            if (type == FILTER_SUB)
+                p = a;
+            else if (type == FILTER_UP)
+                p = b[j];
+            else if (type == FILTER_AVERAGE)
+                p = (a + b[j]) / 2;
+            else if (type == FILTER_PAETH)
+                p = paethPredictor(a, b[j], c);
+            o[j] = f[j] + p;
         }
+        if (bpp == 3)
+            o[3] = 0xff;
     }
+}
 
-    return idx;
+#if CPU_X86
+static inline __m128i loadPixel(const u8 *p, u32 bpp)
+{
+    u32 v;
+    if (bpp == 4)
+        memcpy(&v, p, 4);
+    else
+        v = p[0] | p[1] << 8 | p[2] << 16;
+    return _mm_cvtsi32_si128((i32)v);
 }
 
-bool reverseFilter(u8 *pixels, u8 *decompData, u32 bpp, u32 width, u32 height)
+static inline void storePixel(u8 *p, __m128i v)
 {
-    u8 *filt, *recon, *prev;
-    enum FT { ftNone = 0, ftSub, ftUp, ftAverage, ftPaeth, firstAverage} type;
-    type  = (FT)*decompData;
-    filt  = decompData + 1;
-    recon = pixels;
-    prev  = recon - 4 * width;
-    type  = (type == ftUp) ? ftNone : (type == ftPaeth) ? ftSub :
-            (type == ftAverage) ? firstAverage : type;
+    u32 x = (u32)_mm_cvtsi128_si32(v);
+    memcpy(p, &x, 4);
+}
 
-    u32 bpl = bpp * width + 1;
-    for (u32 i = 0; i < height; i ++) {
-        type = (FT)*decompData;
-        filt = decompData + 1;
-        if (type == ftNone) {
-            for (u32 i = 0; i < width; i ++) {
-                for (u32 j = 0; j < bpp; j ++)
-                    recon[j] = filt[j];
-                recon += 4, prev += 4, filt += bpp;
-            }
-        } else if (type == ftSub) {
-            for (u32 j = 0; j < bpp; j ++)
-                recon[j] = filt[j];
-            recon += 4, prev += 4, filt += bpp;
-            for (u32 i = 1; i < width; i ++) {
-                for (u32 j = 0; j < bpp; j ++)
-                    recon[j] = filt[j] + (recon - 4)[j];
-                recon += 4, prev += 4, filt += bpp;
-            }
-        } else if (type == ftUp) {
-            for (u32 i = 0; i < width; i ++) {
-                for (u32 j = 0; j < bpp; j ++)
-                    recon[j] = filt[j] + prev[j];
-                recon += 4, prev += 4, filt += bpp;
-            }
-        } else if (type == ftAverage) {
-            for (u32 j = 0; j < bpp; j ++)
-                recon[j] = filt[j] + prev[j] / 2;
-            recon += 4, prev += 4, filt += bpp;
-            for (u32 i = 1; i < width; i ++) {
-                for (u32 j = 0; j < bpp; j ++)
-                    recon[j] = filt[j] + (prev[j] + (recon - 4)[j]) / 2;
-                recon += 4, prev += 4, filt += bpp;
-            }
-        } else if (type == ftPaeth) {
-            for (u32 j = 0; j < bpp; j ++)
-                recon[j] = filt[j] + prev[j];
-            recon += 4, prev += 4, filt += bpp;
-            for (u32 i = 1; i < width; i ++) {
-                for (u32 j = 0; j < bpp; j ++)
-                    recon[j] = filt[j] + paethPredictor((recon - 4)[j], prev[j], (prev - 4)[j]);
-                recon += 4, prev += 4, filt += bpp;
-            }
-        }else if (type == firstAverage) {
-            for (u32 j = 0; j < bpp; j ++)
-                recon[j] = filt[j];
-            recon += 4, prev += 4, filt += bpp;
-            for (u32 i = 1; i < width; i ++) {
-                for (u32 j = 0; j < bpp; j ++)
-                    recon[j] = filt[j] + (recon - 4)[j] / 2;
-                recon += 4, prev += 4, filt += bpp;
-            }
-        } else {
-            errorStr = "corrupt PNG, invalid filter type";
-            return false;
+// sixteen bytes of four pixels are added to the running sum of the pixels
+// to their left, a holds the pixel before them in every lane
+static inline __m128i prefixSum(__m128i x, __m128i a)
+{
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+    return _mm_add_epi8(x, a);
+}
+
+static void unfilterSSE2(u8 *out, const u8 *prev, const u8 *filt, u32 start, u32 width, u32 bpp, u32 type)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32(bpp == 3 ? (i32)0xff000000 : 0);
+    u32 i = start;
+
+    // four pixels at a time while the rows line up byte for byte
+    if (bpp == 4 && type != FILTER_AVERAGE && type != FILTER_PAETH) {
+        __m128i a = _mm_shuffle_epi32(i ? loadPixel(out + i * 4 - 4, 4) : _mm_setzero_si128(), 0);
+        for (; i + 4 <= width; i += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(filt + i * 4));
+            if (type == FILTER_UP)
+                x = _mm_add_epi8(x, _mm_loadu_si128((const __m128i *)(prev + i * 4)));
+            else if (type == FILTER_SUB)
+                x = prefixSum(x, a);
+            _mm_storeu_si128((__m128i *)(out + i * 4), x);
+            a = _mm_shuffle_epi32(x, 0xff);
         }
-        decompData += bpl;
     }
+
+    __m128i a = i ? loadPixel(out + i * 4 - 4, 4) : zero;
+    __m128i c = i ? loadPixel(prev + i * 4 - 4, 4) : zero;
+    switch (type) {
+    case FILTER_NONE:
+        for (; i < width; i ++)
+            storePixel(out + i * 4, _mm_or_si128(loadPixel(filt + i * bpp, bpp), alpha));
+        break;
+    case FILTER_SUB:
+        for (; i < width; i ++) {
+            a = _mm_or_si128(_mm_add_epi8(loadPixel(filt + i * bpp, bpp), a), alpha);
+            storePixel(out + i * 4, a);
+        }
+        break;
+    case FILTER_UP:
+        for (; i < width; i ++) {
+            __m128i b = loadPixel(prev + i * 4, 4);
+            storePixel(out + i * 4, _mm_or_si128(_mm_add_epi8(loadPixel(filt + i * bpp, bpp), b), alpha));
+        }
+        break;
+    case FILTER_AVERAGE:
+        for (; i < width; i ++) {
+            // avg rounds up, take the carry back off for the odd sums
+            __m128i b = loadPixel(prev + i * 4, 4);
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+            a = _mm_or_si128(_mm_add_epi8(loadPixel(filt + i * bpp, bpp), avg), alpha);
+            storePixel(out + i * 4, a);
+        }
+        break;
+    case FILTER_PAETH:
+        for (; i < width; i ++) {
+            // p - a, p - b and p - c in 16 bit lanes are b - c, a - c and
+            // their sum, the predictor is the first of a, b and c closest to p
+            __m128i b = loadPixel(prev + i * 4, 4);
+            __m128i a16 = _mm_unpacklo_epi8(a, zero);
+            __m128i b16 = _mm_unpacklo_epi8(b, zero);
+            __m128i c16 = _mm_unpacklo_epi8(c, zero);
+            __m128i pa = _mm_sub_epi16(b16, c16);
+            __m128i pb = _mm_sub_epi16(a16, c16);
+            __m128i pc = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            __m128i smallest = _mm_min_epi16(_mm_min_epi16(pa, pb), pc);
+            __m128i useA = _mm_cmpeq_epi16(pa, smallest);
+            __m128i useB = _mm_andnot_si128(useA, _mm_cmpeq_epi16(pb, smallest));
+            __m128i p = _mm_or_si128(_mm_and_si128(useA, a16), _mm_and_si128(useB, b16));
+            p = _mm_or_si128(p, _mm_andnot_si128(_mm_or_si128(useA, useB), c16));
+            p = _mm_packus_epi16(p, p);
+            a = _mm_or_si128(_mm_add_epi8(loadPixel(filt + i * bpp, bpp), p), alpha);
+            storePixel(out + i * 4, a);
+            c = b;
+        }
+        break;
+    }
+}
+
+// 3 byte pixels are spread out to 4 bytes with a shuffle, four pixels at a
+// time for the filters without a dependency on the neighbouring pixel
+TARGET_SSSE3 static void unfilterSSSE3(u8 *out, const u8 *prev, const u8 *filt, u32 start, u32 width, u32 bpp, u32 type)
+{
+    u32 i = start;
+    if (bpp == 3 && type != FILTER_AVERAGE && type != FILTER_PAETH) {
+        const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha  = _mm_set1_epi32((i32)0xff000000);
+        __m128i a = _mm_shuffle_epi32(i ? loadPixel(out + i * 4 - 4, 4) : _mm_setzero_si128(), 0);
+
+        // sixteen bytes are loaded for the twelve that are used
+        for (; i + 6 <= width; i += 4) {
+            __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(filt + i * 3)), expand);
+            if (type == FILTER_UP)
+                x = _mm_add_epi8(x, _mm_loadu_si128((const __m128i *)(prev + i * 4)));
+            else if (type == FILTER_SUB)
+                x = prefixSum(x, a);
+            x = _mm_or_si128(x, alpha);
+            _mm_storeu_si128((__m128i *)(out + i * 4), x);
+            a = _mm_shuffle_epi32(x, 0xff);
+        }
+    }
+    unfilterSSE2(out, prev, filt, i, width, bpp, type);
+}
+#endif
+
+static UnfilterKernel unfilterKernel()
+{
+    static const UnfilterKernel kernel =
+#if CPU_X86
+        cpuHasSSSE3() ? unfilterSSSE3 :
+        cpuHasSSE2()  ? unfilterSSE2  :
+#endif
+        unfilterScalar;
+    return kernel;
+}
+
+bool unfilterPNGRow(PNGUnfilterPath path, u8 *out, const u8 *prev, const u8 *filt,
+                    u32 start, u32 width, u32 bpp, u32 type)
+{
+    ASSERT((bpp == 3 || bpp == 4) && type <= FILTER_PAETH, "invalid row");
+    UnfilterKernel kernel = nullptr;
+    switch (path) {
+        case PNG_UNFILTER_SCALAR: kernel = unfilterScalar; break;
+#if CPU_X86
+        case PNG_UNFILTER_SSE2  : kernel = cpuHasSSE2()  ? unfilterSSE2  : nullptr; break;
+        case PNG_UNFILTER_SSSE3 : kernel = cpuHasSSSE3() ? unfilterSSSE3 : nullptr; break;
+#endif
+        default: break;
+    }
+    if (!kernel)
+        return false;
+    kernel(out, prev, filt, start, width, bpp, type);
     return true;
 }
 
@@ -537,73 +1014,3 @@ u32 correctEndian(u32 a)
     else return a;
 #undef BSWAP
 }
-
-u32 idatGetBits(ByteBuffer *idat, size_t n, ByteBuffer *b)
-{
-    ASSERT(n <= 32, "getting too many bits");
-    u32 ret = 0;
-    size_t i = 0;
-    while (n > 0) {
-        if (idat->byteCount <= 0) {
-            Chunk chunk;
-            if (!getChunk(b, &chunk, *(u32*)"IDAT")) {
-                errorStr = "corrupt PNG, IDAT chunks missing or not consecutive";
-                break;
-            }
-            *idat = chunk.data;
-        }
-        u8 bits = *idat->bytes >> (8 - idat->bitCount);
-        if (n > idat->bitCount) {
-            ret |= bits << i;
-            i += idat->bitCount;
-            n -= idat->bitCount;
-            idat->bytes ++;
-            idat->byteCount --;
-            idat->bitCount = 8;
-        } else if (idat->bitCount > 0) {
-            bits &= (1 << n) - 1;
-            ret |= bits << i;
-            idat->bitCount -= n;
-            i += n;
-            n -= n;
-        }
-        else break;
-    }
-    return ret;
-}
-
-void huffmanConstruct(Huffman *h)
-{
-    u32 base[MAX_CODE_LENGTH + 1];
-    memset(h->counts , 0, sizeof(u32) * (h->maxLen + 1));
-    for (u32 i = 0; i < h->symCount; i ++)
-        h->counts[h->lengths[i]]++;
-    h->counts[0] = 0;
-    i32 acc = 0;
-    for (u32 i = 0; i <= h->maxLen; i++) {
-        base[i] = acc;
-        acc += h->counts[i];
-    }
-    for (u32 i = 0; i < h->symCount; i++) {
-        i32 len = h->lengths[i];
-        if (len) h->symbols[base[len]++] = i;
-    }
-}
-
-i32 huffmanDecode(ByteBuffer *idat, ByteBuffer *b, Huffman *h)
-{
-    u32 code = 0, base = 0, first = 0;
-    for (u32 len = 1; len <= h->maxLen; len++) {
-        first = (first + h->counts[len - 1]) << 1;
-        code |= idatGetBits(idat, 1, b);
-        i32 count = h->counts[len];
-        if (count) {
-            i32 off = code - first;
-            if (off >= 0 && off < count)
-                return h->symbols[base + off];
-            base += h->counts[len];
-        }
-        code <<= 1;
-    }
-    return -1;
-}
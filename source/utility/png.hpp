@@ -4,3 +4,43 @@
 u8 *loadPNGFromFile(const char *file_name, u32 *w, u32 *h);
 u8 *loadPNGFromMemory(const u8 *buffer, size_t size, u32 *w, u32 *h);
 const char *getPNGError();
+
+// the row unfilter kernels, picked by the decoder from what the cpu has.
+// they are reachable one by one so tools/pngCheck.cpp can hold the SIMD
+// kernels to the scalar one
+enum PNGUnfilterPath { PNG_UNFILTER_SCALAR, PNG_UNFILTER_SSE2, PNG_UNFILTER_SSSE3 };
+
+// unfilters pixels [start, width) of a row into RGBA, false when the cpu
+// or the build has no such kernel
+bool unfilterPNGRow(PNGUnfilterPath path, u8 *out, const u8 *prev, const u8 *filt,
+                    u32 start, u32 width, u32 bpp, u32 type);
+
+struct PNGStream;
+
+// decodes a PNG a few rows at a time, only the deflate window and two rows
+// are kept around so the pixels can go straight to their destination
+// failures are reported through getPNGError and close the decoder
+class PNGDecoder {
+public:
+     PNGDecoder();
+    ~PNGDecoder();
+
+    // the buffer has to outlive the decoder
+    bool open(const u8 *buffer, size_t size);
+    bool openFile(const char *fileName);
+
+    // writes the next count rows as RGBA to dst, pitch bytes apart
+    bool readRows(u8 *dst, u32 count, size_t pitch);
+
+    inline u32 getWidth () const { return m_width; }
+    inline u32 getHeight() const { return m_height; }
+    inline u32 getRow   () const { return m_row; }
+
+private:
+    PNGStream *m_stream;
+    MappedFile m_file;
+    u32 m_width, m_height;
+    u32 m_row;
+
+    void _close();
+};
@@ -0,0 +1,108 @@
+#include "threadPool.hpp"
+
+static thread_local const ThreadPool *t_pool = nullptr;
+static thread_local u32 t_worker = 0;
+
+ThreadPool::ThreadPool(u32 nthreads) :
+    m_queued(0), m_pending(0), m_sleeping(0), m_next(0), m_quit(false)
+{
+    if (!nthreads) {
+        u32 hw = std::thread::hardware_concurrency();
+        nthreads = hw > 1 ? hw - 1 : 1;
+    }
+
+    m_count = nthreads;
+    m_workers.reset(new Worker[nthreads]);
+    for (u32 i = 0; i < nthreads; i ++)
+        m_threads.emplace_back(&ThreadPool::_work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_jobAvailable.notify_all();
+    for (auto &t : m_threads)
+        t.join();
+}
+
+void ThreadPool::submit(Job job)
+{
+    // counted before the job is in a deque so the counts never run short
+    m_pending ++;
+    m_queued ++;
+    u32 target = t_pool == this ? t_worker : m_next++ % getThreadCount();
+    {
+        Worker &w = m_workers[target];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        w.jobs.push_back(std::move(job));
+    }
+
+    // a worker going to sleep counts itself before it looks at m_queued,
+    // so either it sees the job or the job sees it
+    if (m_sleeping) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobAvailable.notify_one();
+    }
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobsDone.wait(lock, [this] { return !m_pending; });
+}
+
+bool ThreadPool::_pop(u32 worker, Job &job)
+{
+    u32 n = getThreadCount();
+    for (u32 i = 0; i < n; i ++) {
+        Worker &w = m_workers[(worker + i) % n];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.jobs.empty())
+            continue;
+
+        // the owner takes its newest job, thieves take the oldest
+        if (i == 0) {
+            job = std::move(w.jobs.back());
+            w.jobs.pop_back();
+        } else {
+            job = std::move(w.jobs.front());
+            w.jobs.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::_work(u32 worker)
+{
+    t_pool = this;
+    t_worker = worker;
+
+    for (;;) {
+        Job job;
+        if (_pop(worker, job)) {
+            m_queued --;
+            job(worker);
+
+            if (!--m_pending) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_jobsDone.notify_all();
+            }
+            continue;
+        }
+
+        m_sleeping ++;
+        bool quit;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobAvailable.wait(lock, [this] { return m_quit || m_queued; });
+            quit = m_quit && !m_queued;
+        }
+        m_sleeping --;
+        if (quit)
+            return;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "utility/common.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <deque>
+
+// every worker owns a deque of jobs, jobs submitted from outside the pool
+// are dealt out round robin and idle workers steal from the others. only
+// the deque being touched is locked, the pool wide mutex is there for
+// sleeping workers and wait
+class ThreadPool {
+public:
+    // jobs receive the index of the worker running them, which can be
+    // used to pick per thread scratch memory
+    typedef std::function<void(u32 worker)> Job;
+
+     ThreadPool(u32 nthreads = 0);
+    ~ThreadPool();
+
+    void submit(Job job);
+    void wait();
+    inline u32 getThreadCount() const { return m_count; }
+
+private:
+    struct Worker {
+        std::deque<Job> jobs;
+        std::mutex mutex;
+    };
+
+    std::vector<std::thread> m_threads;
+    u32 m_count; // set before the workers start, they read it to steal
+    std::unique_ptr<Worker[]> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_jobAvailable;
+    std::condition_variable m_jobsDone;
+    std::atomic<u32> m_queued;   // jobs sitting in a deque
+    std::atomic<u32> m_pending;  // jobs submitted and not yet finished
+    std::atomic<u32> m_sleeping; // workers waiting for a job
+    std::atomic<u32> m_next;
+    bool m_quit;
+
+    bool _pop(u32 worker, Job &job);
+    void _work(u32 worker);
+};
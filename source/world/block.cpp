@@ -25,175 +25,101 @@ static inline u8 calcAO(u8 s1, u8 s2, u8 co) {
     return 3 - (s1 + s2 + co);
 }
 
-static inline u32 pack(u32 x, u32 y, u32 z, u8 n, u8 uv, u8 ao, u8 t)
+// first word of a face record, the block the quad starts at, its
+// direction and its size in blocks. a record of all zeros has no size and
+// draws nothing
+static inline u32 packQuad(u32 x, u32 y, u32 z, u32 w, u32 h, FaceDir d)
 {
-    u32 r = ((x  & ONES(4)) <<  0) |
-            ((z  & ONES(4)) <<  4) |
-            ((y  & ONES(8)) <<  8) |
-            ((n  & ONES(3)) << 16) |
-            ((uv & ONES(2)) << 19) |
-            ((ao & ONES(2)) << 21) |
-            ((t  & ONES(8)) << 23) ;
+    ASSERT(w && w <= ONES(5) && h && h <= ONES(5), "quad too large");
+    u32 r = ((x & ONES(4)) <<  0) |
+            ((z & ONES(4)) <<  4) |
+            ((y & ONES(8)) <<  8) |
+            ((d & ONES(3)) << 16) |
+            ((w & ONES(5)) << 19) |
+            ((h & ONES(5)) << 24) ;
     return r;
 }
 
 enum {
-    _NEG_ = 1 << 2,
-    _X_   = 0,
-    _Y_   = 1,
-    _Z_   = 2,
+    _X_ = 0,
+    _Y_ = 1,
+    _Z_ = 2,
+};
 
-    N_WST = _NEG_ | _X_,
-    N_EST = _X_,
-    N_BOT = _NEG_ | _Y_,
-    N_TOP = _Y_,
-    N_SOU = _NEG_ | _Z_,
-    N_NOR = _Z_,
+// shaders/faces.glsl has the same axes for the vertex shaders, the two
+// have to be changed together
+const FaceAxes faceAxes[_FACE_DIR_MAX_] = {
+    {_Z_, _X_, _Y_}, // SOUTH
+    {_Z_, _X_, _Y_}, // NORTH
+    {_X_, _Z_, _Y_}, // EAST
+    {_X_, _Z_, _Y_}, // WEST
+    {_Y_, _X_, _Z_}, // TOP
+    {_Y_, _X_, _Z_}, // BOTTOM
 };
 
-void fillVerts(u32 *verts, u32 &count, u32 x, u32 y, u32 z, u8 c, const Surrounding &su)
+static inline bool isFaceVisible(u8 neighbour, u8 c)
 {
-    ASSERT(c != AIR && c < _BLOCK_TYPE_MAX_, "invalid block type");
-    u8 t = blockIndex[c].t;
-    u8 s = blockIndex[c].s;
-    u8 b = blockIndex[c].b;
-    u8 a0, a1, a2, a3;
+    return neighbour == AIR || (neighbour == WATER && c != WATER);
+}
+
+static inline Face makeFace(u8 c, u8 a0, u8 a1, u8 a2, u8 a3)
+{
+    return (1 << 16) | (c << 8) | (a3 << 6) | (a2 << 4) | (a1 << 2) | a0;
+}
 
-    // SOUTH
-    if (su.ms == AIR || (su.ms == WATER && c != WATER)) {
-        a0 = calcAO(su.bs, su.msw, su.bsw);
-        a1 = calcAO(su.ts, su.msw, su.tsw);
-        a2 = calcAO(su.bs, su.mse, su.bse);
-        a3 = calcAO(su.ts, su.mse, su.tse);
-        if (a0 * a3 < a1 * a2) {
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_SOU, 3, a2, s);
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_SOU, 1, a0, s);
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_SOU, 0, a1, s);
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_SOU, 3, a2, s);
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_SOU, 0, a1, s);
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_SOU, 2, a3, s);
-        } else {
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_SOU, 1, a0, s);
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_SOU, 0, a1, s);
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_SOU, 2, a3, s);
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_SOU, 1, a0, s);
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_SOU, 2, a3, s);
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_SOU, 3, a2, s);
-        }
-    }
+void fillFaces(Face *faces, u8 c, const Surrounding &su)
+{
+    ASSERT(c != AIR && c < _BLOCK_TYPE_MAX_, "invalid block type");
+    faces[FACE_SOUTH] = !isFaceVisible(su.ms, c) ? 0 : makeFace(c,
+        calcAO(su.bs, su.msw, su.bsw), calcAO(su.ts, su.msw, su.tsw),
+        calcAO(su.bs, su.mse, su.bse), calcAO(su.ts, su.mse, su.tse));
+    faces[FACE_NORTH] = !isFaceVisible(su.mn, c) ? 0 : makeFace(c,
+        calcAO(su.bn, su.mne, su.bne), calcAO(su.tn, su.mne, su.tne),
+        calcAO(su.bn, su.mnw, su.bnw), calcAO(su.tn, su.mnw, su.tnw));
+    faces[FACE_EAST ] = !isFaceVisible(su.me, c) ? 0 : makeFace(c,
+        calcAO(su.be, su.mse, su.bse), calcAO(su.te, su.mse, su.tse),
+        calcAO(su.be, su.mne, su.bne), calcAO(su.te, su.mne, su.tne));
+    faces[FACE_WEST ] = !isFaceVisible(su.mw, c) ? 0 : makeFace(c,
+        calcAO(su.bw, su.mnw, su.bnw), calcAO(su.tw, su.mnw, su.tnw),
+        calcAO(su.bw, su.msw, su.bsw), calcAO(su.tw, su.msw, su.tsw));
+    faces[FACE_TOP  ] = !isFaceVisible(su.t , c) ? 0 : makeFace(c,
+        calcAO(su.tw, su.ts, su.tsw), calcAO(su.tw, su.tn, su.tnw),
+        calcAO(su.te, su.ts, su.tse), calcAO(su.te, su.tn, su.tne));
+    faces[FACE_BOTTOM] = !isFaceVisible(su.b , c) ? 0 : makeFace(c,
+        calcAO(su.be, su.bn, su.bne), calcAO(su.bw, su.bn, su.bnw),
+        calcAO(su.be, su.bs, su.bse), calcAO(su.bw, su.bs, su.bsw));
+}
 
-    // NORTH
-    if (su.mn == AIR || (su.mn == WATER && c != WATER)) {
-        a0 = calcAO(su.bn, su.mne, su.bne);
-        a1 = calcAO(su.tn, su.mne, su.tne);
-        a2 = calcAO(su.bn, su.mnw, su.bnw);
-        a3 = calcAO(su.tn, su.mnw, su.tnw);
-        if (a0 * a3 < a1 * a2) {
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_NOR, 1, a2, s);
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_NOR, 3, a0, s);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_NOR, 2, a1, s);
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_NOR, 1, a2, s);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_NOR, 2, a1, s);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_NOR, 0, a3, s);
-        } else {
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_NOR, 3, a0, s);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_NOR, 2, a1, s);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_NOR, 0, a3, s);
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_NOR, 3, a0, s);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_NOR, 0, a3, s);
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_NOR, 1, a2, s);
-        }
-    }
+u8 casterFaces(const Surrounding &su)
+{
+    auto open = [](u8 n) { return n == AIR || n == WATER; };
+    return (u8)(open(su.ms) << FACE_SOUTH | open(su.mn) << FACE_NORTH |
+                open(su.me) << FACE_EAST  | open(su.mw) << FACE_WEST  |
+                open(su.t ) << FACE_TOP);
+}
 
-    // EAST
-    if (su.me == AIR || (su.me == WATER && c != WATER)) {
-        a0 = calcAO(su.be, su.mse, su.bse);
-        a1 = calcAO(su.te, su.mse, su.tse);
-        a2 = calcAO(su.be, su.mne, su.bne);
-        a3 = calcAO(su.te, su.mne, su.tne);
-        if (a0 * a3 < a1 * a2) {
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_EST, 3, a2, s);
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_EST, 1, a0, s);
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_EST, 0, a1, s);
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_EST, 3, a2, s);
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_EST, 0, a1, s);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_EST, 2, a3, s);
-        } else {
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_EST, 1, a0, s);
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_EST, 0, a1, s);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_EST, 2, a3, s);
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_EST, 1, a0, s);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_EST, 2, a3, s);
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_EST, 3, a2, s);
-        }
-    }
+void fillCasterQuad(u32 *records, u32 &count, u32 x, u32 y, u32 z, u32 w, u32 h, FaceDir d)
+{
+    ASSERT(d < FACE_BOTTOM, "invalid caster face");
+    records[count++] = packQuad(x, y, z, w, h, d);
+}
 
-    // WEST
-    if (su.mw == AIR || (su.mw == WATER && c != WATER)) {
-        a0 = calcAO(su.bw, su.mnw, su.bnw);
-        a1 = calcAO(su.tw, su.mnw, su.tnw);
-        a2 = calcAO(su.bw, su.msw, su.bsw);
-        a3 = calcAO(su.tw, su.msw, su.tsw);
-        if (a0 * a3 < a1 * a2) {
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_WST, 1, a2, s);
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_WST, 3, a0, s);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_WST, 2, a1, s);
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_WST, 1, a2, s);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_WST, 2, a1, s);
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_WST, 0, a3, s);
-        } else {
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_WST, 3, a0, s);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_WST, 2, a1, s);
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_WST, 0, a3, s);
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_WST, 3, a0, s);
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_WST, 0, a3, s);
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_WST, 1, a2, s);
-        }
-    }
+void fillQuad(u64 *records, u32 &count, u32 x, u32 y, u32 z, u32 w, u32 h, FaceDir d, Face f)
+{
+    ASSERT(f && d < _FACE_DIR_MAX_, "invalid face");
+    u8 c = faceBlock(f);
+    u8 t = d == FACE_TOP ? blockIndex[c].t : d == FACE_BOTTOM ? blockIndex[c].b : blockIndex[c].s;
 
-    // TOP
-    if (su.t  == AIR || (su.t  == WATER && c != WATER)) {
-        a0 = calcAO(su.tw, su.ts, su.tsw);
-        a1 = calcAO(su.tw, su.tn, su.tnw);
-        a2 = calcAO(su.te, su.ts, su.tse);
-        a3 = calcAO(su.te, su.tn, su.tne);
-        if (a0 * a3 < a1 * a2) {
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_TOP, 2, a2, t);
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_TOP, 0, a0, t);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_TOP, 1, a1, t);
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_TOP, 2, a2, t);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_TOP, 1, a1, t);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_TOP, 3, a3, t);
-        } else {
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_TOP, 0, a0, t);
-            verts[count++] = pack(x + 0, y + 1, z + 1, N_TOP, 1, a1, t);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_TOP, 3, a3, t);
-            verts[count++] = pack(x + 0, y + 1, z + 0, N_TOP, 0, a0, t);
-            verts[count++] = pack(x + 1, y + 1, z + 1, N_TOP, 3, a3, t);
-            verts[count++] = pack(x + 1, y + 1, z + 0, N_TOP, 2, a2, t);
-        }
-    }
+    // the second word holds the ambient occlusion of the corners and the
+    // texture layer, the vertex shader picks the diagonal from the former
+    u32 hi = (f & ONES(8)) | (u32)t << 8;
+    records[count++] = packQuad(x, y, z, w, h, d) | (u64)hi << 32;
+}
 
-    // BOTTOM
-    if (su.b  == AIR || (su.b  == WATER && c != WATER)) {
-        a0 = calcAO(su.be, su.bn, su.bne);
-        a1 = calcAO(su.bw, su.bn, su.bnw);
-        a2 = calcAO(su.be, su.bs, su.bse);
-        a3 = calcAO(su.bw, su.bs, su.bsw);
-        if (a0 * a3 < a1 * a2) {
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_BOT, 2, a2, b);
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_BOT, 3, a0, b);
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_BOT, 1, a1, b);
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_BOT, 2, a2, b);
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_BOT, 1, a1, b);
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_BOT, 0, a3, b);
-        } else {
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_BOT, 3, a0, b);
-            verts[count++] = pack(x + 0, y + 0, z + 1, N_BOT, 1, a1, b);
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_BOT, 0, a3, b);
-            verts[count++] = pack(x + 1, y + 0, z + 1, N_BOT, 3, a0, b);
-            verts[count++] = pack(x + 0, y + 0, z + 0, N_BOT, 0, a3, b);
-            verts[count++] = pack(x + 1, y + 0, z + 0, N_BOT, 2, a2, b);
-        }
-    }
+void fillRecords(u64 *records, u32 &count, u32 x, u32 y, u32 z, u8 c, const Surrounding &su)
+{
+    Face faces[_FACE_DIR_MAX_];
+    fillFaces(faces, c, su);
+    for (u32 d = 0; d < _FACE_DIR_MAX_; d ++)
+        if (faces[d]) fillQuad(records, count, x, y, z, 1, 1, (FaceDir)d, faces[d]);
 }
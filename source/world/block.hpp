@@ -27,4 +27,41 @@ struct Surrounding {
     u8 bne, bnw, bse, bsw;
 };
 
-void fillVerts(u32 *verts, u32 &count, u32 x, u32 y, u32 z, u8 c, const Surrounding &s);
+enum FaceDir {
+    FACE_SOUTH,
+    FACE_NORTH,
+    FACE_EAST,
+    FACE_WEST,
+    FACE_TOP,
+    FACE_BOTTOM,
+
+    _FACE_DIR_MAX_
+};
+
+// axis perpendicular to a face and the two axes spanned by its quad (0 = x, 1 = y, 2 = z)
+struct FaceAxes { u8 axis, u, v; };
+extern const FaceAxes faceAxes[_FACE_DIR_MAX_];
+
+// visible face of a block, 0 when the face is hidden
+// bits 0-7 ambient occlusion (2 bits per corner), 8-15 block type, 16 visible
+typedef u32 Face;
+
+inline u8   faceBlock(Face f) { return (f >> 8) & 0xff; }
+inline bool faceFlatAO(Face f) { return (f & 0xff) == (f & 3) * 0x55; }
+
+void fillFaces(Face *faces, u8 c, const Surrounding &s);
+
+// a quad is written as a single record the vertex shader expands into its
+// corners, the faces of a block at (x, y, z) span w by h blocks along the
+// axes of faceAxes
+// bits 0-3 x, 4-7 z, 8-15 y, 16-18 FaceDir, 19-23 w, 24-28 h,
+// 32-39 ambient occlusion of the corners as in Face, 40-47 texture layer
+void fillQuad(u64 *records, u32 &count, u32 x, u32 y, u32 z, u32 w, u32 h, FaceDir d, Face f);
+
+// faces of an opaque block that can cast a shadow, one bit per FaceDir.
+// bottom faces never face the sun while it is up and water lets it through
+u8 casterFaces(const Surrounding &s);
+
+// caster records are the first word of a full record and nothing else
+void fillCasterQuad(u32 *records, u32 &count, u32 x, u32 y, u32 z, u32 w, u32 h, FaceDir d);
+void fillRecords(u64 *records, u32 &count, u32 x, u32 y, u32 z, u8 c, const Surrounding &s);
@@ -0,0 +1,185 @@
+#include "blockStorage.hpp"
+#include <string.h>
+
+static inline u32 columnIndex(u32 x, u32 z)
+{
+    return (x * CHUNK_MAX_Z + z) * SECTION_HEIGHT;
+}
+
+static inline u32 wordCount(u32 bits)
+{
+    return (BlockSection::volume * bits + 63) / 64;
+}
+
+static inline u32 readIndex(const BlockSection &s, u32 i)
+{
+    u32 bit = i * s.bits;
+    return (s.data[bit >> 6] >> (bit & 63)) & ((1u << s.bits) - 1);
+}
+
+static inline void writeIndex(BlockSection &s, u32 i, u32 v)
+{
+    u32 bit = i * s.bits;
+    u64 mask = (u64)((1u << s.bits) - 1) << (bit & 63);
+    u64 &w = s.data[bit >> 6];
+    w = (w & ~mask) | ((u64)v << (bit & 63));
+}
+
+BlockStorage::BlockStorage(u8 t)
+{
+    fill(t);
+}
+
+void BlockStorage::fill(u8 t)
+{
+    for (auto &s : m_sections) {
+        s.bits = 0;
+        s.paletteSize = 1;
+        s.palette[0] = t;
+        s.data = std::vector<u64>();
+    }
+}
+
+u8 BlockStorage::get(u32 x, u32 y, u32 z) const
+{
+    ASSERT(x < CHUNK_MAX_X && y < CHUNK_MAX_Y && z < CHUNK_MAX_Z, "block out of range");
+    const BlockSection &s = m_sections[y / SECTION_HEIGHT];
+    if (!s.bits)
+        return s.palette[0];
+    u32 v = readIndex(s, columnIndex(x, z) + y % SECTION_HEIGHT);
+    return s.bits == 8 ? v : s.palette[v];
+}
+
+void BlockStorage::set(u32 x, u32 y, u32 z, u8 t)
+{
+    ASSERT(x < CHUNK_MAX_X && y < CHUNK_MAX_Y && z < CHUNK_MAX_Z, "block out of range");
+    BlockSection &s = m_sections[y / SECTION_HEIGHT];
+    u32 i = columnIndex(x, z) + y % SECTION_HEIGHT;
+
+    u32 v = 0;
+    if (s.bits != 8) {
+        while (v < s.paletteSize && s.palette[v] != t)
+            v ++;
+        if (v == s.paletteSize) {
+            if (s.bits == 0 || s.paletteSize == 1u << s.bits)
+                _grow(s);
+            if (s.bits != 8)
+                s.palette[s.paletteSize++] = t;
+        }
+        if (!s.bits)
+            return;
+    }
+
+    writeIndex(s, i, s.bits == 8 ? t : v);
+}
+
+void BlockStorage::_grow(BlockSection &s)
+{
+    BlockSection n;
+    n.bits = s.bits ? s.bits * 2 : 1;
+    n.paletteSize = s.paletteSize;
+    memcpy(n.palette, s.palette, sizeof(n.palette));
+    n.data.assign(wordCount(n.bits), 0);
+
+    // indices turn into block types once the palette is dropped
+    if (s.bits)
+        for (u32 i = 0; i < BlockSection::volume; i ++) {
+            u32 v = readIndex(s, i);
+            writeIndex(n, i, n.bits == 8 ? s.palette[v] : v);
+        }
+    else if (n.bits == 8)
+        for (u32 i = 0; i < BlockSection::volume; i ++)
+            writeIndex(n, i, s.palette[0]);
+
+    s = std::move(n);
+}
+
+void BlockStorage::compress(const BlockGrid &blocks)
+{
+    for (u32 k = 0; k < SECTION_COUNT; k ++) {
+        BlockSection &s = m_sections[k];
+        u32 y0 = k * SECTION_HEIGHT;
+        u32 y1 = y0 + SECTION_HEIGHT < CHUNK_MAX_Y ? y0 + SECTION_HEIGHT : CHUNK_MAX_Y;
+
+        u8 lut[256];
+        bool seen[256] = {};
+        u32 count = 0;
+        for (u32 x = 0; x < CHUNK_MAX_X; x ++) {
+            for (u32 z = 0; z < CHUNK_MAX_Z; z ++) {
+                for (u32 y = y0; y < y1; y ++) {
+                    u8 t = blocks[x][z][y];
+                    if (seen[t]) continue;
+                    seen[t] = true;
+                    if (count < BlockSection::maxPalette)
+                        s.palette[count] = t;
+                    lut[t] = count++;
+                }
+            }
+        }
+
+        s.bits = count == 1 ? 0 : count <= 2 ? 1 : count <= 4 ? 2 : count <= 16 ? 4 : 8;
+        s.paletteSize = count < BlockSection::maxPalette ? count : BlockSection::maxPalette;
+        if (!s.bits) {
+            s.data = std::vector<u64>();
+            continue;
+        }
+
+        // packs whole columns at a time, the padding above the top of the
+        // chunk is left as index 0
+        std::vector<u64> data(wordCount(s.bits), 0);
+        u32 bits = s.bits;
+        for (u32 x = 0; x < CHUNK_MAX_X; x ++) {
+            for (u32 z = 0; z < CHUNK_MAX_Z; z ++) {
+                const u8 *col = blocks[x][z];
+                u32 bit = columnIndex(x, z) * bits;
+                for (u32 y = y0; y < y1; y ++, bit += bits) {
+                    u64 v = bits == 8 ? col[y] : lut[col[y]];
+                    data[bit >> 6] |= v << (bit & 63);
+                }
+            }
+        }
+        s.data = std::move(data);
+    }
+}
+
+void BlockStorage::decodeColumn(u32 x, u32 z, u8 *out) const
+{
+    ASSERT(x < CHUNK_MAX_X && z < CHUNK_MAX_Z, "column out of range");
+    u32 base = columnIndex(x, z);
+    for (u32 k = 0; k < SECTION_COUNT; k ++, out += SECTION_HEIGHT) {
+        const BlockSection &s = m_sections[k];
+        u32 n = CHUNK_MAX_Y - k * SECTION_HEIGHT;
+        n = n < SECTION_HEIGHT ? n : SECTION_HEIGHT;
+
+        if (!s.bits) {
+            memset(out, s.palette[0], n);
+            continue;
+        }
+
+        // a column is at most two words, and only one below 8 bits
+        // everything is copied to locals first as out may alias the section
+        u32 bits = s.bits;
+        u32 bit = base * bits;
+        const u64 *w = &s.data[bit >> 6];
+        u64 mask = (1u << bits) - 1;
+        if (bits == 8) {
+            u64 lo = w[0], hi = w[1];
+            for (u32 i = 0; i < n; i ++)
+                out[i] = ((i < 8 ? lo : hi) >> ((i & 7) * 8)) & mask;
+        } else {
+            u8 palette[BlockSection::maxPalette];
+            memcpy(palette, s.palette, sizeof(palette));
+            u64 word = w[0] >> (bit & 63);
+            for (u32 i = 0; i < n; i ++, word >>= bits)
+                out[i] = palette[word & mask];
+        }
+    }
+}
+
+size_t BlockStorage::getMemoryUsage() const
+{
+    size_t r = sizeof(*this);
+    for (auto &s : m_sections)
+        r += s.data.capacity() * sizeof(u64);
+    return r;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "utility/common.hpp"
+#include <vector>
+
+constexpr u32 CHUNK_MAX_Y = 255;
+constexpr u32 CHUNK_MAX_X = 15;
+constexpr u32 CHUNK_MAX_Z = 15;
+
+constexpr u32 SECTION_HEIGHT = 16;
+constexpr u32 SECTION_COUNT  = (CHUNK_MAX_Y + SECTION_HEIGHT - 1) / SECTION_HEIGHT;
+
+typedef u8 BlockGrid[CHUNK_MAX_X][CHUNK_MAX_Z][CHUNK_MAX_Y];
+
+// one 16 high slice of a chunk, blocks are stored as 1, 2 or 4 bit indices
+// into a small palette, as the block types themselves with 8 bits, or not
+// at all when the whole section is a single type (palette[0])
+// the 16 blocks of a column are packed next to each other so a column of a
+// section never straddles a word
+struct BlockSection {
+    static constexpr u32 volume     = CHUNK_MAX_X * CHUNK_MAX_Z * SECTION_HEIGHT;
+    static constexpr u32 maxPalette = 16;
+
+    u8 bits;
+    u8 paletteSize;
+    u8 palette[maxPalette];
+    std::vector<u64> data;
+};
+
+class BlockStorage {
+public:
+    BlockStorage(u8 t = 0);
+    ~BlockStorage() = default;
+
+    u8   get(u32 x, u32 y, u32 z) const;
+    void set(u32 x, u32 y, u32 z, u8 t);
+    void fill(u8 t);
+
+    // replaces the contents with a dense grid, picking the smallest
+    // palette for every section
+    void compress(const BlockGrid &blocks);
+
+    // writes the CHUNK_MAX_Y blocks of column (x, z) to out
+    void decodeColumn(u32 x, u32 z, u8 *out) const;
+
+    inline const BlockSection &getSection(u32 i) const { return m_sections[i]; }
+    size_t getMemoryUsage() const;
+
+private:
+    BlockSection m_sections[SECTION_COUNT];
+
+    /// <summary>
+    /// Moves a section to the next index width once its palette is full
+    /// </summary>
+    void _grow(BlockSection &s);
+};
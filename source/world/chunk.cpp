@@ -1,21 +1,27 @@
-#include "glad/glad.h"
-#include "rendering/shader.hpp"
+#include "rendering/bufferArena.hpp"
 #include "world/chunk.hpp"
 #include "world/block.hpp"
 #include "utility/noise.hpp"
 
 #include <math.h>
 #include <memory.h>
+#include <chrono>
 
 static constexpr i32 seaLevel      = 65;
 static constexpr  u8 baseHeight    = 45;
 static constexpr  u8 maxHeight     = 150;
 
+static constexpr u32 regionBit(u32 rx, u32 rz) { return 1 << (rx * 3 + rz); }
+
+static constexpr u32 REGIONS_WEST  = regionBit(0, 0) | regionBit(0, 1) | regionBit(0, 2);
+static constexpr u32 REGIONS_EAST  = regionBit(2, 0) | regionBit(2, 1) | regionBit(2, 2);
+static constexpr u32 REGIONS_SOUTH = regionBit(0, 0) | regionBit(1, 0) | regionBit(2, 0);
+static constexpr u32 REGIONS_NORTH = regionBit(0, 2) | regionBit(1, 2) | regionBit(2, 2);
+
 Chunk::Chunk() :
-    m_vao(DYNAMIC)
+    m_blocks(AIR)
 {
-    memset(m_blocks, AIR, sizeof(m_blocks));
-
+    _classifySections();
     m_east      = s_dummy();
     m_west      = s_dummy();
     m_north     = s_dummy();
@@ -25,24 +31,34 @@ Chunk::Chunk() :
     m_northwest = s_dummy();
     m_southwest = s_dummy();
 
-    m_opaquevertcount = 0;
-    m_transparentvertcount = 0;
+    m_rangeOffset = 0;
+    m_rangeSize = 0;
+    m_opaquecount = 0;
+    m_transparentcount = 0;
+    m_casterRangeOffset = 0;
+    m_casterRangeSize = 0;
+    m_castercount = 0;
+    m_meshStats = {};
     m_state = Initial;
-
-    m_vao.bind();
-    VertexAttrib va = {0, 1, UINT};
-    m_vao.setAttribs(1, &va);
+    m_version = 0;
+
+    // nothing is meshed yet
+    memset(m_slots, 0, sizeof(m_slots));
+    memset(m_casterSlots, 0, sizeof(m_casterSlots));
+    memset(m_partFaceQuads, 0, sizeof(m_partFaceQuads));
+    for (auto &d : m_dirty)
+        d = 0xffff;
 }
 
 void Chunk::resetNeighbours() {
-    m_east     ->m_west      = s_dummy(); m_east     ->m_state = NeedsUpdating;
-    m_west     ->m_east      = s_dummy(); m_west     ->m_state = NeedsUpdating;
-    m_north    ->m_south     = s_dummy(); m_north    ->m_state = NeedsUpdating;
-    m_south    ->m_north     = s_dummy(); m_south    ->m_state = NeedsUpdating;
-    m_northeast->m_southwest = s_dummy(); m_northeast->m_state = NeedsUpdating;
-    m_southeast->m_northwest = s_dummy(); m_southeast->m_state = NeedsUpdating;
-    m_northwest->m_southeast = s_dummy(); m_northwest->m_state = NeedsUpdating;
-    m_southwest->m_northeast = s_dummy(); m_southwest->m_state = NeedsUpdating;
+    m_east     ->m_west      = s_dummy(); m_east     ->_markEdgeDirty(REGIONS_WEST);
+    m_west     ->m_east      = s_dummy(); m_west     ->_markEdgeDirty(REGIONS_EAST);
+    m_north    ->m_south     = s_dummy(); m_north    ->_markEdgeDirty(REGIONS_SOUTH);
+    m_south    ->m_north     = s_dummy(); m_south    ->_markEdgeDirty(REGIONS_NORTH);
+    m_northeast->m_southwest = s_dummy(); m_northeast->_markEdgeDirty(regionBit(0, 0));
+    m_southeast->m_northwest = s_dummy(); m_southeast->_markEdgeDirty(regionBit(0, 2));
+    m_northwest->m_southeast = s_dummy(); m_northwest->_markEdgeDirty(regionBit(2, 0));
+    m_southwest->m_northeast = s_dummy(); m_southwest->_markEdgeDirty(regionBit(2, 2));
 
     m_east      = s_dummy();
     m_west      = s_dummy();
@@ -52,30 +68,87 @@ void Chunk::resetNeighbours() {
     m_southeast = s_dummy();
     m_northwest = s_dummy();
     m_southwest = s_dummy();
+    _markDirty();
+}
+
+Chunk::Chunk(u8 t) : m_blocks(t) { m_version = 0; _classifySections(); }
+void Chunk::invalidate() { if (m_state != Initial) _markDirty(); }
+void Chunk::setEast     (Chunk *p) { m_east      = p; p->m_west      = this; _markEdgeDirty(REGIONS_EAST ); p->_markEdgeDirty(REGIONS_WEST ); }
+void Chunk::setWest     (Chunk *p) { m_west      = p; p->m_east      = this; _markEdgeDirty(REGIONS_WEST ); p->_markEdgeDirty(REGIONS_EAST ); }
+void Chunk::setNorth    (Chunk *p) { m_north     = p; p->m_south     = this; _markEdgeDirty(REGIONS_NORTH); p->_markEdgeDirty(REGIONS_SOUTH); }
+void Chunk::setSouth    (Chunk *p) { m_south     = p; p->m_north     = this; _markEdgeDirty(REGIONS_SOUTH); p->_markEdgeDirty(REGIONS_NORTH); }
+void Chunk::setNorthEast(Chunk *p) { m_northeast = p; p->m_southwest = this; _markEdgeDirty(regionBit(2, 2)); p->_markEdgeDirty(regionBit(0, 0)); }
+void Chunk::setSouthEast(Chunk *p) { m_southeast = p; p->m_northwest = this; _markEdgeDirty(regionBit(2, 0)); p->_markEdgeDirty(regionBit(0, 2)); }
+void Chunk::setNorthWest(Chunk *p) { m_northwest = p; p->m_southeast = this; _markEdgeDirty(regionBit(0, 2)); p->_markEdgeDirty(regionBit(2, 0)); }
+void Chunk::setSouthWest(Chunk *p) { m_southwest = p; p->m_northeast = this; _markEdgeDirty(regionBit(0, 0)); p->_markEdgeDirty(regionBit(2, 2)); }
+
+void Chunk::_markDirty(u32 regions, u16 sections)
+{
+    for (u32 r = 0; r < MESH_REGIONS; r ++)
+        if (regions & (1 << r))
+            m_dirty[r] |= sections;
     m_state = NeedsUpdating;
+    m_version ++;
+}
+
+void Chunk::_markEdgeDirty(u32 regions)
+{
+    u16 sections = 0;
+    for (u32 k = 0; k < SECTION_COUNT; k ++)
+        if (m_sectionTypes[k] != SECTION_AIR)
+            sections |= 1 << k;
+    if (sections)
+        _markDirty(regions, sections);
+}
+
+void Chunk::takeDirty(u16 dirty[MESH_REGIONS])
+{
+    memcpy(dirty, m_dirty, sizeof(m_dirty));
+    memset(m_dirty, 0, sizeof(m_dirty));
 }
 
-Chunk::Chunk(u8 t) { memset(m_blocks, t, sizeof(m_blocks)); }
-void Chunk::setEast     (Chunk *p) { m_east      = p; p->m_west      = this; m_state = NeedsUpdating; p->m_state = NeedsUpdating; }
-void Chunk::setWest     (Chunk *p) { m_west      = p; p->m_east      = this; m_state = NeedsUpdating; p->m_state = NeedsUpdating; }
-void Chunk::setNorth    (Chunk *p) { m_north     = p; p->m_south     = this; m_state = NeedsUpdating; p->m_state = NeedsUpdating; }
-void Chunk::setSouth    (Chunk *p) { m_south     = p; p->m_north     = this; m_state = NeedsUpdating; p->m_state = NeedsUpdating; }
-void Chunk::setNorthEast(Chunk *p) { m_northeast = p; p->m_southwest = this; m_state = NeedsUpdating; p->m_state = NeedsUpdating; }
-void Chunk::setSouthEast(Chunk *p) { m_southeast = p; p->m_northwest = this; m_state = NeedsUpdating; p->m_state = NeedsUpdating; }
-void Chunk::setNorthWest(Chunk *p) { m_northwest = p; p->m_southeast = this; m_state = NeedsUpdating; p->m_state = NeedsUpdating; }
-void Chunk::setSouthWest(Chunk *p) { m_southwest = p; p->m_northeast = this; m_state = NeedsUpdating; p->m_state = NeedsUpdating; }
-
-bool Chunk::_checkForOakTree(i32 x, i32 y, i32 z)
+void Chunk::_classifySections()
+{
+    for (u32 k = 0; k < SECTION_COUNT; k ++) {
+        // the palette holds every type in the section, at 8 bits it is no
+        // longer kept and the section counts as mixed
+        const BlockSection &s = m_blocks.getSection(k);
+        bool air = false, open = false;
+        for (u32 i = 0; i < s.paletteSize; i ++) {
+            air  = air  || s.palette[i] == AIR;
+            open = open || s.palette[i] == AIR || s.palette[i] == WATER;
+        }
+        m_sectionTypes[k] = s.bits == 8 ? SECTION_MIXED :
+                            !s.bits && air ? SECTION_AIR :
+                            !open ? SECTION_SOLID : SECTION_MIXED;
+    }
+
+    u32 lo = 0, hi = SECTION_COUNT;
+    while (lo < hi && m_sectionTypes[lo] == SECTION_AIR)
+        lo ++;
+    while (hi > lo && m_sectionTypes[hi - 1] == SECTION_AIR)
+        hi --;
+    m_minY = (f32)(lo * SECTION_HEIGHT);
+    m_maxY = (f32)(hi * SECTION_HEIGHT < CHUNK_MAX_Y ? hi * SECTION_HEIGHT : CHUNK_MAX_Y);
+}
+
+void Chunk::getBounds(Vec3 &center, Vec3 &extent) const
+{
+    extent = Vec3(CHUNK_MAX_X / 2.0f, (m_maxY - m_minY) / 2.0f, CHUNK_MAX_Z / 2.0f);
+    center = Vec3(m_renderOrigin.x + extent.x, m_minY + extent.y, m_renderOrigin.z + extent.z);
+}
+
+bool Chunk::_checkForOakTree(const BlockGrid &blocks, i32 x, i32 y, i32 z)
 {
     if (x == 7 && z == 7 &&
         y > seaLevel &&
-        m_blocks[x][z][y] == GRASS)
+        blocks[x][z][y] == GRASS)
         return true;
     else
         return false;
 }
 
-void Chunk::_placeOakTree(i32 x, i32 y, i32 z, pcg32_random_t *rng)
+void Chunk::_placeOakTree(BlockGrid &blocks, i32 x, i32 y, i32 z, pcg32_random_t *rng)
 {
     u32 treeHeight;//Sets the max height of the tree
     u32 randomHeight = (pcg32_random_r(rng) & 7);
@@ -85,9 +158,9 @@ void Chunk::_placeOakTree(i32 x, i32 y, i32 z, pcg32_random_t *rng)
     u32 max    = 3 + randomHeight;
     u32 ymax = y + treeHeight - 1;
 
-    auto placeLeaf = [this](i32 y, i32 x, i32 z) {
-        if (m_blocks[x][z][y] == AIR)
-            m_blocks[x][z][y] = OAKLEAF;
+    auto placeLeaf = [&blocks](i32 y, i32 x, i32 z) {
+        if (blocks[x][z][y] == AIR)
+            blocks[x][z][y] = OAKLEAF;
     };
 
     auto placeLeaves = [placeLeaf](i32 cx, i32 y, i32 cz, i8 r) {
@@ -110,197 +183,516 @@ void Chunk::_placeOakTree(i32 x, i32 y, i32 z, pcg32_random_t *rng)
     };
 
     for (i32 k = ymax; k >= y; k--) {
-        m_blocks[x][z][k] = OAKTREETRUNK;
+        blocks[x][z][k] = OAKTREETRUNK;
         if((count ++) < max) {
             u32 radius = count / 2 + 2;
             placeLeaves(x, k, z, radius);
         }
     }
 
-    m_blocks[x][z][y - 1] = DIRT;
-    m_blocks[x][z][y + treeHeight] = OAKLEAF;
+    blocks[x][z][y - 1] = DIRT;
+    blocks[x][z][y + treeHeight] = OAKLEAF;
 }
 
 void Chunk::generate(i32 x, i32 z, FBMConfig& fc)
 {
     pcg32_random_t rng = { (((u64)x * 3452189327901ull + 12682897369ull) * ((u64)z * 129728736478123ull + 1987724839021ull)) | 1, 32874012398623949ull };
 
-    m_state = NeedsUpdating;
-
     m_origin = Vec3((f32)x * CHUNK_MAX_X, 0, (f32)z * CHUNK_MAX_Z);
     m_center = {m_origin.x + CHUNK_MAX_X / 2.0f, CHUNK_MAX_Y / 2.0f, m_origin.z + CHUNK_MAX_Z / 2.0f};
     bool hasTree = false;
-    memset(m_blocks, AIR, sizeof(m_blocks));
+
+    // terrain is built in a dense per thread grid and compressed at the end
+    static thread_local BlockGrid blocks;
+    memset(blocks, AIR, sizeof(blocks));
+
+    // sample the whole column grid up front so the noise runs batched
+    constexpr u32 columns = CHUNK_MAX_X * CHUNK_MAX_Z;
+    f32 px[columns], pz[columns], nx[columns], nz[columns], ns[columns], hs[columns];
+    for (u8 cx = 0; cx < CHUNK_MAX_X; cx++) {
+        for (u8 cz = 0; cz < CHUNK_MAX_Z; cz++) {
+            u32 i = cx * CHUNK_MAX_Z + cz;
+            px[i] = x + cx / (f32)CHUNK_MAX_X;
+            pz[i] = z + cz / (f32)CHUNK_MAX_Z;
+            nx[i] = px[i] / 32.0f;
+            nz[i] = pz[i] / 32.0f;
+        }
+    }
+    noiseBatch(nx, nz, ns, columns, fc.permutation);
+    fbmBatch(px, pz, hs, columns, fc);
 
     for (u8 cx = 0; cx < CHUNK_MAX_X; cx++) {
         for (u8 cz = 0; cz < CHUNK_MAX_Z; cz++)  {
-            f32 n = noise((x + cx / (f32)CHUNK_MAX_X) / 32.0f, (z + cz / (f32)CHUNK_MAX_Z) / 32.0f, fc.permutation) * 0.5 + 0.5;
-            u8 height = (u8)(fbm(x + cx / (f32)CHUNK_MAX_X, z + cz / (f32)CHUNK_MAX_Z, fc)
-                * maxHeight * n + baseHeight);
+            u32 i = cx * CHUNK_MAX_Z + cz;
+            f32 n = ns[i] * 0.5 + 0.5;
+            u8 height = (u8)(hs[i] * maxHeight * n + baseHeight);
 
             if (height > seaLevel) {
-                m_blocks[cx][cz][height - 1] = GRASS;
+                blocks[cx][cz][height - 1] = GRASS;
                 for (i32 y = 0; y < height - 1; y++)
-                    m_blocks[cx][cz][y] = DIRT;
+                    blocks[cx][cz][y] = DIRT;
 
                 for (i32 y = seaLevel - 5; y <= seaLevel + 5; y++) {
                     i32 d = y - seaLevel + 1;
                     d = d < 0 ? -d : d;
-                    auto &cur = m_blocks[cx][cz][y];
+                    auto &cur = blocks[cx][cz][y];
                     if ((cur == GRASS || cur == DIRT) && ((pcg32_random_r(&rng) & (u32)(((1 << d) - 1) <= d))))
                         cur = SAND;
                 }
 
-                if (!hasTree && _checkForOakTree(cx, height - 1, cz)) {
+                if (!hasTree && _checkForOakTree(blocks, cx, height - 1, cz)) {
                     if (!(pcg32_random_r(&rng) & 7)) {
                         hasTree = true;
-                        _placeOakTree(cx, height, cz, &rng);
+                        _placeOakTree(blocks, cx, height, cz, &rng);
                     }
                 }
             } else {
                 for (i32 y = height; y < seaLevel; y++)
-                    m_blocks[cx][cz][y] = WATER;
+                    blocks[cx][cz][y] = WATER;
                 for (i32 y = 0; y < height; y++)
-                    m_blocks[cx][cz][y] = SAND;
+                    blocks[cx][cz][y] = SAND;
             }
         }
     }
+
+    m_blocks.compress(blocks);
+    _classifySections();
 }
 
-void Chunk::renderPrep(const Shader &shader)
+// merges coplanar faces of the same block type and flat ambient occlusion
+// into larger quads within the box [lo, hi), faces are consumed from the
+// grid as they are emitted
+static void greedyMerge(MeshScratch &scratch, const u32 lo[3], const u32 hi[3], u32 &opaquecount, u32 &transparentcount)
 {
-    shader.uniform("xz", m_renderOrigin.x, m_renderOrigin.z);
-    m_vao.bind();
+    auto &faces = scratch.faces;
+
+    for (u32 d = 0; d < _FACE_DIR_MAX_; d ++) {
+        const FaceAxes &a = faceAxes[d];
+        u32 p[3];
+        auto at = [&faces, &p, &a, d](u32 i, u32 j) -> Face& {
+            u32 q[3] = {p[0], p[1], p[2]};
+            q[a.u] = i, q[a.v] = j;
+            return faces[q[0]][q[2]][q[1]][d];
+        };
+
+        for (p[a.axis] = lo[a.axis]; p[a.axis] < hi[a.axis]; p[a.axis] ++) {
+            for (u32 j = lo[a.v]; j < hi[a.v]; j ++) {
+                for (u32 i = lo[a.u]; i < hi[a.u]; i ++) {
+                    Face f = at(i, j);
+                    if (!f) continue;
+
+                    u32 w = 1, h = 1;
+                    if (faceFlatAO(f)) {
+                        while (i + w < hi[a.u] && at(i + w, j) == f)
+                            w ++;
+                        while (j + h < hi[a.v]) {
+                            u32 k = 0;
+                            while (k < w && at(i + k, j + h) == f) k ++;
+                            if (k < w) break;
+                            h ++;
+                        }
+                    }
+
+                    for (u32 l = 0; l < h; l ++)
+                        for (u32 k = 0; k < w; k ++)
+                            at(i + k, j + l) = 0;
+
+                    p[a.u] = i, p[a.v] = j;
+                    if (faceBlock(f) == WATER) fillQuad(scratch.transparent, transparentcount, p[0], p[1], p[2], w, h, (FaceDir)d, f);
+                    else fillQuad(scratch.opaque, opaquecount, p[0], p[1], p[2], w, h, (FaceDir)d, f);
+                    i += w - 1;
+                }
+            }
+        }
+    }
 }
 
-void Chunk::renderOpaque()
+// merges the caster faces within the box [lo, hi) into larger quads, block
+// types and ambient occlusion do not matter to a shadow so any two faces
+// facing the same way merge
+static void mergeCasters(MeshScratch &scratch, const u32 lo[3], const u32 hi[3], u32 &count)
 {
-    if (!m_opaquevertcount) return;
-    glDrawArrays(GL_TRIANGLES, 0, m_opaquevertcount);
+    auto &casters = scratch.casters;
+
+    for (u32 d = 0; d < FACE_BOTTOM; d ++) {
+        const FaceAxes &a = faceAxes[d];
+        const u8 bit = 1 << d;
+        u32 p[3];
+        auto at = [&casters, &p, &a](u32 i, u32 j) -> u8& {
+            u32 q[3] = {p[0], p[1], p[2]};
+            q[a.u] = i, q[a.v] = j;
+            return casters[q[0]][q[2]][q[1]];
+        };
+
+        for (p[a.axis] = lo[a.axis]; p[a.axis] < hi[a.axis]; p[a.axis] ++) {
+            for (u32 j = lo[a.v]; j < hi[a.v]; j ++) {
+                for (u32 i = lo[a.u]; i < hi[a.u]; i ++) {
+                    if (!(at(i, j) & bit)) continue;
+
+                    u32 w = 1, h = 1;
+                    while (i + w < hi[a.u] && (at(i + w, j) & bit))
+                        w ++;
+                    while (j + h < hi[a.v]) {
+                        u32 k = 0;
+                        while (k < w && (at(i + k, j + h) & bit)) k ++;
+                        if (k < w) break;
+                        h ++;
+                    }
+
+                    for (u32 l = 0; l < h; l ++)
+                        for (u32 k = 0; k < w; k ++)
+                            at(i + k, j + l) &= ~bit;
+
+                    p[a.u] = i, p[a.v] = j;
+                    fillCasterQuad(scratch.casterRecords, count, p[0], p[1], p[2], w, h, (FaceDir)d);
+                    i += w - 1;
+                }
+            }
+        }
+    }
 }
 
-void Chunk::renderTransparent()
+// columns [lo, hi) of range i (0, 1 or 2) of a region along an axis of length m
+static inline void regionRange(u32 i, u32 m, u32 &lo, u32 &hi)
 {
-    if (!m_transparentvertcount) return;
-    glEnable(GL_BLEND);
-    glDrawArrays(GL_TRIANGLES, m_opaquevertcount, m_transparentvertcount);
-    glDisable(GL_BLEND);
+    lo = i == 0 ? 0 : i == 1 ? 1 : m - 1;
+    hi = i == 0 ? 1 : i == 1 ? m - 1 : m;
 }
 
-static constexpr u32 maxVertCount = CHUNK_MAX_X * CHUNK_MAX_Y * CHUNK_MAX_Z * 6 * 6;
-static u32 opaqueverts[maxVertCount];
-static u32 transparentverts[maxVertCount];
-
-void Chunk::update()
+void Chunk::mesh(MeshMode mode, bool casters, MeshScratch &scratch, ChunkMesh &out) const
 {
-    m_state = Ready;
-    m_renderOrigin = m_origin;
-    m_opaquevertcount = 0;
-    m_transparentvertcount = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    u32 opaquecount = 0;
+    u32 transparentcount = 0;
+    u32 castercount = 0;
+    u32 facecount = 0;
     static constexpr u32 XMAX = CHUNK_MAX_X - 1;
     static constexpr u32 ZMAX = CHUNK_MAX_Z - 1;
-    static constexpr u32 YMAX = CHUNK_MAX_Y - 1;
-    const u8 *c, *e, *w, *n, *s, *ne, *nw, *se, *sw;
-    const u8 (*nne)[CHUNK_MAX_Y];
-    const u8 (*nnw)[CHUNK_MAX_Y];
-
-    for (u32 x = 0; x <= XMAX; x ++) {
-        c = m_south->m_blocks[x][ZMAX];
-        n = m_blocks[x][0];
-
-        if (x == 0) {
-            nnw = m_west->m_blocks[XMAX];
-            nne = m_blocks[x + 1];
-            w = m_southwest->m_blocks[XMAX][ZMAX];
-            e = m_south->m_blocks[x + 1][ZMAX];
-        } else if (x == XMAX) {
-            nnw = m_blocks[x - 1];
-            nne = m_east->m_blocks[0];
-            w = m_south->m_blocks[x - 1][ZMAX];
-            e = m_southeast->m_blocks[0][ZMAX];
+
+    // snapshot of the columns around the dirty regions, index 0 and MAX + 1
+    // on x and z belong to the neighbours
+    const Chunk *sources[3][3] = {
+        {m_southwest, m_west, m_northwest},
+        {m_south    , this  , m_north    },
+        {m_southeast, m_east, m_northeast},
+    };
+    bool decoded[CHUNK_MAX_X + 2][CHUNK_MAX_Z + 2] = {};
+    auto &blocks = scratch.blocks;
+    for (u32 r = 0; r < MESH_REGIONS; r ++) {
+        if (!out.dirty[r]) continue;
+        u32 x0, x1, z0, z1;
+        regionRange(r / 3, CHUNK_MAX_X, x0, x1);
+        regionRange(r % 3, CHUNK_MAX_Z, z0, z1);
+        for (u32 px = x0; px < x1 + 2; px ++) {
+            for (u32 pz = z0; pz < z1 + 2; pz ++) {
+                if (decoded[px][pz]) continue;
+                decoded[px][pz] = true;
+                u32 sx = px == 0 ? 0 : px <= CHUNK_MAX_X ? 1 : 2;
+                u32 sz = pz == 0 ? 0 : pz <= CHUNK_MAX_Z ? 1 : 2;
+                u32 cx = sx == 0 ? XMAX : sx == 1 ? px - 1 : 0;
+                u32 cz = sz == 0 ? ZMAX : sz == 1 ? pz - 1 : 0;
+                sources[sx][sz]->m_blocks.decodeColumn(cx, cz, blocks[px][pz]);
+            }
+        }
+    }
+
+    auto emit = [&](u32 x, u32 y, u32 z, u8 curr, const Surrounding &su) {
+        if (curr == AIR)
+            return;
+        if (casters && curr != WATER)
+            scratch.casters[x][z][y] = casterFaces(su);
+
+        if (mode == MESH_GREEDY) {
+            Face *f = scratch.faces[x][z][y];
+            fillFaces(f, curr, su);
+            for (u32 d = 0; d < _FACE_DIR_MAX_; d ++)
+                facecount += f[d] != 0;
+        } else if (curr == WATER) {
+            fillRecords(scratch.transparent, transparentcount, x, y, z, curr, su);
         } else {
-            nnw = m_blocks[x - 1];
-            nne = m_blocks[x + 1];
-            w = m_south->m_blocks[x - 1][ZMAX];
-            e = m_south->m_blocks[x + 1][ZMAX];
+            fillRecords(scratch.opaque, opaquecount, x, y, z, curr, su);
         }
+    };
 
-        ne = nne[0];
-        nw = nnw[0];
-
-        for (u32 z = 0; z <= ZMAX; z ++) {
-            se = e, e = ne;
-            s  = c, c = n;
-            sw = w, w = nw;
-
-            if (z == ZMAX) {
-                n = m_north->m_blocks[x][0];
-                if (x == 0) {
-                    nw = m_northwest->m_blocks[XMAX][0];
-                    ne = m_north->m_blocks[x + 1][0];
-                } else if (x == XMAX) {
-                    nw = m_north->m_blocks[x - 1][0];
-                    ne = m_northeast->m_blocks[0][0];
-                } else {
-                    nw = m_north->m_blocks[x - 1][0];
-                    ne = m_north->m_blocks[x + 1][0];
-                }
-            } else {
-                n  = m_blocks[x][z + 1];
-                ne = nne[z + 1];
-                nw = nnw[z + 1];
+    // everything above and below the chunk is air, y wraps around below 0
+    auto row = [](const u8 *col, u32 y) -> u8 {
+        return y < CHUNK_MAX_Y ? col[y] : (u8)AIR;
+    };
+
+    auto meshColumn = [&](u32 x, u32 z, u32 y0, u32 y1, SectionType type) {
+        const u8 *c  = blocks[x + 1][z + 1];
+        const u8 *e  = blocks[x + 2][z + 1];
+        const u8 *w  = blocks[x + 0][z + 1];
+        const u8 *n  = blocks[x + 1][z + 2];
+        const u8 *s  = blocks[x + 1][z + 0];
+        const u8 *ne = blocks[x + 2][z + 2];
+        const u8 *nw = blocks[x + 0][z + 2];
+        const u8 *se = blocks[x + 2][z + 0];
+        const u8 *sw = blocks[x + 0][z + 0];
+        Surrounding su;
+
+        auto gather = [&](u32 y) {
+            su.t   = row( c, y + 1); su.b   = row( c, y - 1);
+            su.te  = row( e, y + 1); su.me  = row( e, y); su.be  = row( e, y - 1);
+            su.tw  = row( w, y + 1); su.mw  = row( w, y); su.bw  = row( w, y - 1);
+            su.tn  = row( n, y + 1); su.mn  = row( n, y); su.bn  = row( n, y - 1);
+            su.ts  = row( s, y + 1); su.ms  = row( s, y); su.bs  = row( s, y - 1);
+            su.tne = row(ne, y + 1); su.mne = row(ne, y); su.bne = row(ne, y - 1);
+            su.tnw = row(nw, y + 1); su.mnw = row(nw, y); su.bnw = row(nw, y - 1);
+            su.tse = row(se, y + 1); su.mse = row(se, y); su.bse = row(se, y - 1);
+            su.tsw = row(sw, y + 1); su.msw = row(sw, y); su.bsw = row(sw, y - 1);
+        };
+
+        // only blocks next to air or water can have visible faces
+        auto exposed = [&](u32 y) {
+            u8 v[6] = {row(c, y + 1), row(c, y - 1), e[y], w[y], n[y], s[y]};
+            for (u8 t : v)
+                if (t == AIR || t == WATER)
+                    return true;
+            return false;
+        };
+
+        if (type == SECTION_SOLID) {
+            // inside the section every neighbour is solid as well,
+            // only the top and bottom layers and the chunk edges are checked
+            bool edge = x == 0 || x == XMAX || z == 0 || z == ZMAX;
+            for (u32 y = y0; y < y1; y += edge ? 1 : y1 - y0 - 1) {
+                if (!exposed(y)) continue;
+                gather(y);
+                emit(x, y, z, c[y], su);
             }
+            return;
+        }
 
-            u8 curr = AIR;
-            Surrounding su = { };
-            su.t   =  c[0], su.te  =  e[0], su.tw  =  w[0],
-            su.tn  =  n[0], su.ts  =  s[0], su.tne = ne[0],
-            su.tnw = nw[0], su.tse = se[0], su.tsw = sw[0];
-
-            u32 y;
-            for (y = 0; y < YMAX; y ++) {
-                su.b   = curr;
-                curr   = c[y];
-                su.t   = c[y + 1];
-                su.be  = su.me ; su.me  = su.te ; su.te  =  e[y + 1];
-                su.bw  = su.mw ; su.mw  = su.tw ; su.tw  =  w[y + 1];
-                su.bn  = su.mn ; su.mn  = su.tn ; su.tn  =  n[y + 1];
-                su.bs  = su.ms ; su.ms  = su.ts ; su.ts  =  s[y + 1];
-                su.bne = su.mne; su.mne = su.tne; su.tne = ne[y + 1];
-                su.bnw = su.mnw; su.mnw = su.tnw; su.tnw = nw[y + 1];
-                su.bse = su.mse; su.mse = su.tse; su.tse = se[y + 1];
-                su.bsw = su.msw; su.msw = su.tsw; su.tsw = sw[y + 1];
-
-                if (curr == WATER) fillVerts(transparentverts, m_transparentvertcount, x, y, z, curr, su);
-                else if (curr != AIR) fillVerts(opaqueverts, m_opaquevertcount, x, y, z, curr, su);
+        // start a level below so the first step rolls the rows into place
+        gather(y0 - 1);
+        for (u32 y = y0; y < y1; y ++) {
+            su.b   = row(c, y - 1);
+            su.t   = row(c, y + 1);
+            su.be  = su.me ; su.me  = su.te ; su.te  = row( e, y + 1);
+            su.bw  = su.mw ; su.mw  = su.tw ; su.tw  = row( w, y + 1);
+            su.bn  = su.mn ; su.mn  = su.tn ; su.tn  = row( n, y + 1);
+            su.bs  = su.ms ; su.ms  = su.ts ; su.ts  = row( s, y + 1);
+            su.bne = su.mne; su.mne = su.tne; su.tne = row(ne, y + 1);
+            su.bnw = su.mnw; su.mnw = su.tnw; su.tnw = row(nw, y + 1);
+            su.bse = su.mse; su.mse = su.tse; su.tse = row(se, y + 1);
+            su.bsw = su.msw; su.msw = su.tsw; su.tsw = row(sw, y + 1);
+            emit(x, y, z, c[y], su);
+        }
+    };
+
+    out.parts.clear();
+    for (u32 r = 0; r < MESH_REGIONS; r ++) {
+        u32 lo[3], hi[3];
+        regionRange(r / 3, CHUNK_MAX_X, lo[0], hi[0]);
+        regionRange(r % 3, CHUNK_MAX_Z, lo[2], hi[2]);
+
+        for (u32 k = 0; k < SECTION_COUNT; k ++) {
+            if (!(out.dirty[r] & (1 << k))) continue;
+            lo[1] = k * SECTION_HEIGHT;
+            hi[1] = lo[1] + SECTION_HEIGHT < CHUNK_MAX_Y ? lo[1] + SECTION_HEIGHT : CHUNK_MAX_Y;
+
+            u32 o = opaquecount, t = transparentcount, c = castercount;
+            facecount = 0;
+            if (m_sectionTypes[k] != SECTION_AIR) {
+                for (u32 x = lo[0]; x < hi[0]; x ++)
+                    for (u32 z = lo[2]; z < hi[2]; z ++)
+                        meshColumn(x, z, lo[1], hi[1], m_sectionTypes[k]);
+                if (mode == MESH_GREEDY)
+                    greedyMerge(scratch, lo, hi, opaquecount, transparentcount);
+                if (casters)
+                    mergeCasters(scratch, lo, hi, castercount);
             }
 
-            su.b   = curr;
-            curr   = c[y];
-            su.t   = AIR;
-            su.be  = su.me ; su.me  = su.te ; su.te  = AIR;
-            su.bw  = su.mw ; su.mw  = su.tw ; su.tw  = AIR;
-            su.bn  = su.mn ; su.mn  = su.tn ; su.tn  = AIR;
-            su.bs  = su.ms ; su.ms  = su.ts ; su.ts  = AIR;
-            su.bne = su.mne; su.mne = su.tne; su.tne = AIR;
-            su.bnw = su.mnw; su.mnw = su.tnw; su.tnw = AIR;
-            su.bse = su.mse; su.mse = su.tse; su.tse = AIR;
-            su.bsw = su.msw; su.msw = su.tsw; su.tsw = AIR;
-            if (curr == WATER) fillVerts(transparentverts, m_transparentvertcount, x, YMAX, z, curr, su);
-            else if (curr != AIR) fillVerts(opaqueverts, m_opaquevertcount, x, YMAX, z, curr, su);
+            MeshPart part;
+            part.part = r * SECTION_COUNT + k;
+            part.opaqueCount = opaquecount - o;
+            part.transparentCount = transparentcount - t;
+            part.casterCount = castercount - c;
+            part.faceQuadCount = mode == MESH_GREEDY ? facecount : part.opaqueCount + part.transparentCount;
+            out.parts.push_back(part);
         }
     }
 
-    auto count = m_transparentvertcount + m_opaquevertcount;
-    if (count) {
-        m_vao.bind();
-        if (!m_opaquevertcount) {
-            m_vao.setData(count * 4, transparentverts);
-        } else if (!m_transparentvertcount) {
-            m_vao.setData(count * 4, opaqueverts);
-        } else {
-            m_vao.setData(count * 4, opaqueverts);
-            m_vao.subData(m_transparentvertcount * 4, transparentverts, m_opaquevertcount * 4);
+    u32 count = opaquecount + transparentcount;
+    out.records.resize(count);
+    memcpy(out.records.data(), scratch.opaque, opaquecount * 8);
+    memcpy(out.records.data() + opaquecount, scratch.transparent, transparentcount * 8);
+    out.opaqueCount = opaquecount;
+    out.transparentCount = transparentcount;
+    out.casterRecords.assign(scratch.casterRecords, scratch.casterRecords + castercount);
+    out.casterCount = castercount;
+
+    std::chrono::duration<f32, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+    out.stats.time = time.count();
+}
+
+static inline u32 slotCapacity(u32 count)
+{
+    return count + (count + 3) / 4;
+}
+
+// lays the slots of kinds lists of slots out again, one kind after the
+// other in a new range of arena. every slot gets some slack so parts can
+// grow a little in place, the parts that were not remeshed are moved over
+// on the gpu with whatever fits of their old slot, which is their records
+// and padding
+static void relayoutSlots(MeshSlot (*slots)[MESH_PARTS], const u32 (*counts)[MESH_PARTS], u32 kinds,
+                          const bool *changed, u32 recordSize, BufferArena &arena,
+                          u32 &rangeOffset, u32 &rangeSize, u32 *totals)
+{
+    std::vector<BufferCopy> copies;
+    u32 offset = 0;
+    for (u32 i = 0; i < kinds; i ++) {
+        u32 begin = offset;
+        for (u32 p = 0; p < MESH_PARTS; p ++) {
+            MeshSlot &slot = slots[i][p];
+            u32 capacity;
+            if (changed[p]) {
+                capacity = slotCapacity(counts[i][p]);
+            } else {
+                capacity = slotCapacity(slot.count);
+                capacity = capacity < slot.capacity ? capacity : slot.capacity;
+                if (capacity)
+                    copies.push_back({slot.offset * recordSize, offset * recordSize, capacity * recordSize});
+            }
+            slot.offset = offset;
+            slot.capacity = capacity;
+            offset += capacity;
+        }
+        totals[i] = offset - begin;
+    }
+
+    // the new range is taken before the old one is released so the copies
+    // never read from memory that was handed out again
+    u32 size = offset * recordSize;
+    u32 range = size ? arena.allocate(size) : 0;
+    for (auto &c : copies)
+        arena.copy(rangeOffset + c.src, range + c.dst, c.size);
+    if (rangeSize)
+        arena.free(rangeOffset, rangeSize);
+
+    rangeOffset = range;
+    rangeSize = size;
+}
+
+void Chunk::_relayout(const ChunkMesh &mesh, BufferArena &arena)
+{
+    bool changed[MESH_PARTS] = {};
+    u32 counts[2][MESH_PARTS];
+    for (auto &p : mesh.parts) {
+        changed[p.part] = true;
+        counts[0][p.part] = p.opaqueCount;
+        counts[1][p.part] = p.transparentCount;
+    }
+
+    u32 total[2];
+    relayoutSlots(m_slots, counts, 2, changed, 8, arena, m_rangeOffset, m_rangeSize, total);
+    m_opaquecount = total[0];
+    m_transparentcount = total[1];
+}
+
+void Chunk::_relayoutCasters(const ChunkMesh &mesh, BufferArena &arena)
+{
+    bool changed[MESH_PARTS] = {};
+    u32 counts[MESH_PARTS];
+    for (auto &p : mesh.parts) {
+        changed[p.part] = true;
+        counts[p.part] = p.casterCount;
+    }
+
+    relayoutSlots(&m_casterSlots, &counts, 1, changed, 4, arena, m_casterRangeOffset, m_casterRangeSize, &m_castercount);
+}
+
+bool Chunk::acceptMesh(const ChunkMesh &mesh)
+{
+    // the chunk changed while it was being meshed, or the mesh was
+    // cancelled, the parts are meshed again along with the newer changes.
+    // a newer mesh may already be back and have marked the chunk ready,
+    // so it is queued again either way
+    if (mesh.cancelled || mesh.version != m_version) {
+        for (u32 r = 0; r < MESH_REGIONS; r ++)
+            m_dirty[r] |= mesh.dirty[r];
+        m_state = NeedsUpdating;
+        return false;
+    }
+
+    // parts handed back by a stale mesh that came in first still need one
+    bool dirty = false;
+    for (u32 r = 0; r < MESH_REGIONS; r ++)
+        dirty = dirty || m_dirty[r];
+    m_state = dirty ? NeedsUpdating : Ready;
+    m_renderOrigin = m_origin;
+    return true;
+}
+
+void Chunk::upload(const ChunkMesh &mesh, BufferArena &arena, BufferArena &casterArena)
+{
+    if (!acceptMesh(mesh))
+        return;
+
+    // lay the slots out again when a part outgrew its slot, or when the
+    // mesh shrank to less than half of its range to give the memory back
+    bool fits = true;
+    u32 used = m_meshStats.quadCount;
+    for (auto &p : mesh.parts) {
+        fits = fits && p.opaqueCount <= m_slots[0][p.part].capacity &&
+               p.transparentCount <= m_slots[1][p.part].capacity;
+        used += p.opaqueCount + p.transparentCount;
+        used -= m_slots[0][p.part].count + m_slots[1][p.part].count;
+    }
+    if (!fits || used * 2 < m_opaquecount + m_transparentcount)
+        _relayout(mesh, arena);
+
+    bool castersFit = true;
+    u32 castersUsed = m_meshStats.casterQuadCount;
+    for (auto &p : mesh.parts) {
+        castersFit = castersFit && p.casterCount <= m_casterSlots[p.part].capacity;
+        castersUsed += p.casterCount;
+        castersUsed -= m_casterSlots[p.part].count;
+    }
+    if (!castersFit || castersUsed * 2 < m_castercount)
+        _relayoutCasters(mesh, casterArena);
+
+    // parts are written padded to the end of their slot, empty records
+    // overwrite whatever the previous mesh left there
+    static std::vector<u64> padded;
+    const u64 *src[2] = {mesh.records.data(), mesh.records.data() + mesh.opaqueCount};
+    for (auto &p : mesh.parts) {
+        u32 counts[2] = {p.opaqueCount, p.transparentCount};
+        for (u32 i = 0; i < 2; i ++) {
+            MeshSlot &slot = m_slots[i][p.part];
+            if (slot.capacity && (counts[i] || slot.count)) {
+                padded.assign(slot.capacity, 0);
+                memcpy(padded.data(), src[i], counts[i] * 8);
+                arena.write(m_rangeOffset + slot.offset * 8, slot.capacity * 8, padded.data());
+            }
+            slot.count = counts[i];
+            src[i] += counts[i];
+        }
+        m_partFaceQuads[p.part] = p.faceQuadCount;
+    }
+
+    static std::vector<u32> casterPadded;
+    const u32 *casterSrc = mesh.casterRecords.data();
+    for (auto &p : mesh.parts) {
+        MeshSlot &slot = m_casterSlots[p.part];
+        if (slot.capacity && (p.casterCount || slot.count)) {
+            casterPadded.assign(slot.capacity, 0);
+            memcpy(casterPadded.data(), casterSrc, p.casterCount * 4);
+            casterArena.write(m_casterRangeOffset + slot.offset * 4, slot.capacity * 4, casterPadded.data());
         }
+        slot.count = p.casterCount;
+        casterSrc += p.casterCount;
+    }
+
+    m_meshStats.quadCount = 0;
+    m_meshStats.faceQuadCount = 0;
+    m_meshStats.casterQuadCount = 0;
+    for (u32 p = 0; p < MESH_PARTS; p ++) {
+        m_meshStats.quadCount += m_slots[0][p].count + m_slots[1][p].count;
+        m_meshStats.faceQuadCount += m_partFaceQuads[p];
+        m_meshStats.casterQuadCount += m_casterSlots[p].count;
     }
+    m_meshStats.time = mesh.stats.time;
 }
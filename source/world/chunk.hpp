@@ -1,34 +1,114 @@
 #pragma once
 
 #include "block.hpp"
+#include "blockStorage.hpp"
 #include "math/vector.hpp"
 #include "utility/common.hpp"
-#include "rendering/vertexArray.hpp"
+#include <vector>
 
 enum ChunkState {
     Initial,
     NeedsUpdating,
+    Meshing,
     Ready,
 };
 
-constexpr u32 CHUNK_MAX_Y = 255;
-constexpr u32 CHUNK_MAX_X = 15;
-constexpr u32 CHUNK_MAX_Z = 15;
+enum MeshMode : int {
+    MESH_PER_FACE,
+    MESH_GREEDY,
+};
+
+// what a 16 high section of a chunk holds, all air sections are skipped by
+// the mesher and only the outer shell of all solid ones can have faces
+enum SectionType : u8 {
+    SECTION_AIR,
+    SECTION_SOLID,
+    SECTION_MIXED,
+};
+
+struct MeshStats {
+    u32 quadCount;       // quads emitted
+    u32 faceQuadCount;   // quads the per face mesher would have emitted
+    u32 casterQuadCount; // quads of the shadow caster mesh
+    f32 time;            // meshing time in milliseconds
+};
 
-class Shader;
+class Chunk;
+class BufferArena;
 struct FBMConfig;
 struct pcg32_random_t;
 
+// the columns of a chunk are split into regions by the neighbours they
+// touch: the interior, four edges and four corners. region r covers the
+// columns with x in range r / 3 and z in range r % 3, where the ranges are
+// 0, 1 .. MAX - 1 and MAX. a part is one section of one region, parts are
+// meshed and uploaded on their own so linking a neighbour only remeshes
+// the edge next to it
+constexpr u32 MESH_REGIONS = 9;
+constexpr u32 MESH_PARTS   = MESH_REGIONS * SECTION_COUNT;
+
+// per thread buffers used while meshing a chunk, faces and casters are kept
+// all zero between meshes so only the faces of visited blocks need to be
+// written
+struct MeshScratch {
+    static constexpr u32 maxQuadCount = CHUNK_MAX_X * CHUNK_MAX_Y * CHUNK_MAX_Z * 6;
+    u64 opaque[maxQuadCount];
+    u64 transparent[maxQuadCount];
+    u32 casterRecords[maxQuadCount];
+    // decoded blocks of the chunk with a one column border from its neighbours
+    u8 blocks[CHUNK_MAX_X + 2][CHUNK_MAX_Z + 2][CHUNK_MAX_Y];
+    Face faces[CHUNK_MAX_X][CHUNK_MAX_Z][CHUNK_MAX_Y][_FACE_DIR_MAX_];
+    u8 casters[CHUNK_MAX_X][CHUNK_MAX_Z][CHUNK_MAX_Y]; // casterFaces of every block
+};
+
+struct MeshPart {
+    u32 part;
+    u32 opaqueCount;
+    u32 transparentCount;
+    u32 casterCount;
+    u32 faceQuadCount;
+};
+
+// range of the chunk buffer owned by one part, in records, the space past
+// count is filled with empty records
+struct MeshSlot {
+    u32 offset;
+    u32 capacity;
+    u32 count;
+};
+
+// result of meshing the dirty parts of a chunk, the opaque records of
+// every part in order followed by the transparent ones. the shadow caster
+// records of every part are kept apart, they go to an arena of their own
+struct ChunkMesh {
+    Chunk *chunk;
+    u32 version;
+    bool cancelled;          // never meshed, only hands the dirty parts back
+    u16 dirty[MESH_REGIONS]; // sections meshed in every region
+    u32 opaqueCount;
+    u32 transparentCount;
+    u32 casterCount;
+    MeshStats stats;
+    std::vector<MeshPart> parts;
+    std::vector<u64> records;
+    std::vector<u32> casterRecords;
+};
+
 class Chunk {
 public:
      Chunk();
     ~Chunk() = default;
 
     void generate(i32 x, i32 z, FBMConfig &fc);
-    void update();
-    void renderPrep(const Shader &shader);
-    void renderOpaque();
-    void renderTransparent();
+    // casters asks for a shadow caster mesh as well, greedy merged whatever
+    // the mode
+    void mesh(MeshMode mode, bool casters, MeshScratch &scratch, ChunkMesh &out) const;
+    void upload(const ChunkMesh &mesh, BufferArena &arena, BufferArena &casterArena);
+    // the bookkeeping upload starts with, false when the mesh is stale and
+    // its parts were handed back to be meshed again
+    bool acceptMesh(const ChunkMesh &mesh);
+    void invalidate();
+    void takeDirty(u16 dirty[MESH_REGIONS]);
 
     void setEast (Chunk *p);
     void setWest (Chunk *p);
@@ -41,6 +121,9 @@ public:
     void resetNeighbours();
 
     inline ChunkState getState() { return m_state; }
+    inline void setState(ChunkState s) { m_state = s; }
+    inline u32 getVersion() const { return m_version; }
+    inline const MeshStats &getMeshStats() const { return m_meshStats; }
     inline Chunk *getEast () { return m_east; }
     inline Chunk *getWest () { return m_west; }
     inline Chunk *getNorth() { return m_north; }
@@ -50,6 +133,22 @@ public:
     inline Chunk *getNorthWest() { return m_northwest; }
     inline Chunk *getSouthWest() { return m_southwest; }
     inline const Vec3 &getCenter() const { return m_center; }
+    inline const Vec3 &getRenderOrigin() const { return m_renderOrigin; }
+    inline u32 getRangeOffset() const { return m_rangeOffset; }
+    inline u32 getRangeSize() const { return m_rangeSize; }
+    // records of one quad each, counts include the empty ones padding the slots
+    inline u32 getFirstRecord() const { return m_rangeOffset / 8; }
+    inline u32 getOpaqueCount() const { return m_opaquecount; }
+    inline u32 getTransparentCount() const { return m_transparentcount; }
+    inline u32 getCasterRangeOffset() const { return m_casterRangeOffset; }
+    inline u32 getCasterRangeSize() const { return m_casterRangeSize; }
+    inline u32 getCasterFirstRecord() const { return m_casterRangeOffset / 4; }
+    inline u32 getCasterCount() const { return m_castercount; }
+    inline const BlockStorage &getBlocks() const { return m_blocks; }
+    inline SectionType getSectionType(u32 i) const { return m_sectionTypes[i]; }
+
+    // box around the blocks of the mesh that is drawn at the moment
+    void getBounds(Vec3 &center, Vec3 &extent) const;
 
 private:
     Chunk(u8 t);
@@ -59,21 +158,60 @@ private:
     Chunk *m_northeast, *m_northwest;
 
     ChunkState m_state;
+    u32 m_version;
     Vec3 m_renderOrigin, m_origin, m_center;
-    u8 m_blocks[CHUNK_MAX_X][CHUNK_MAX_Z][CHUNK_MAX_Y];
-    VertexArray m_vao;
-    u32 m_opaquevertcount;
-    u32 m_transparentvertcount;
+    BlockStorage m_blocks;
+    SectionType m_sectionTypes[SECTION_COUNT];
+    f32 m_minY, m_maxY; // height range of the sections that are not air
+    u32 m_rangeOffset, m_rangeSize; // bytes of the world chunk buffer
+    u32 m_opaquecount;
+    u32 m_transparentcount;
+    u32 m_casterRangeOffset, m_casterRangeSize; // bytes of the caster buffer
+    u32 m_castercount;
+    MeshStats m_meshStats;
+
+    u16 m_dirty[MESH_REGIONS];
+    MeshSlot m_slots[2][MESH_PARTS]; // opaque and transparent, from the start of the range
+    MeshSlot m_casterSlots[MESH_PARTS];
+    u32 m_partFaceQuads[MESH_PARTS];
+
+    /// <summary>
+    /// Queues the given sections of the given regions for meshing and
+    /// invalidates meshes already in flight
+    /// </summary>
+    void _markDirty(u32 regions = (1 << MESH_REGIONS) - 1, u16 sections = 0xffff);
+
+    /// <summary>
+    /// Marks the regions next to a neighbour, only sections that are not
+    /// all air can have faces that depend on it
+    /// </summary>
+    void _markEdgeDirty(u32 regions);
+
+    /// <summary>
+    /// Lays the slots of all parts out again when a part outgrew its slot
+    /// </summary>
+    void _relayout(const ChunkMesh &mesh, BufferArena &arena);
+
+    /// <summary>
+    /// Same as _relayout for the slots of the caster mesh
+    /// </summary>
+    void _relayoutCasters(const ChunkMesh &mesh, BufferArena &arena);
+
+    /// <summary>
+    /// Works out the SectionType of every section from the block storage and
+    /// the height range they span
+    /// </summary>
+    void _classifySections();
 
     /// <summary>
     /// Draws the main body of the tree
     /// </summary>
-    void _placeOakTree(i32 x, i32 y, i32 z, pcg32_random_t *seed);
+    void _placeOakTree(BlockGrid &blocks, i32 x, i32 y, i32 z, pcg32_random_t *seed);
 
     /// <summary>
     /// Makes sure tree spawns near the centre so leaves don't get cut off
     /// </summary>
-    bool _checkForOakTree(i32 x, i32 y, i32 z);
+    bool _checkForOakTree(const BlockGrid &blocks, i32 x, i32 y, i32 z);
 
     static Chunk *s_dummy() {
         static Chunk dummy(DIRT);
@@ -1,8 +1,11 @@
+#include "glad/glad.h"
 #include "math/matrix.hpp"
 #include "world/world.hpp"
 #include "world/chunk.hpp"
 #include "world/block.hpp"
 #include "rendering/shader.hpp"
+#include "rendering/frustum.hpp"
+#include "utility/assets.hpp"
 #include <algorithm>
 
 struct ChunkDistPair {
@@ -17,10 +20,34 @@ static i32 mod(i32 o, i32 n)
     return o & (n - 1);
 }
 
+
+void World::queueAssets()
+{
+    Assets::queueImage(BLOCK_TEXTURE_FILE, MIP_CHAIN);
+}
+
 World::World(u32 nchunks) :
-    m_textureArray(0, BLOCK_TEXTURE_FILE, BLOCK_TILES_PER_ROW, BLOCK_TILES_PER_COLUMN)
+    m_textureArray(0, BLOCK_TEXTURE_FILE, BLOCK_TILES_PER_ROW, BLOCK_TILES_PER_COLUMN),
+    m_arena(4 << 20, 5, GL_RG32UI),
+    m_chunkOrigins(2, GL_RG32F, m_arena.getCapacity() / BufferArena::pageSize * 8),
+    m_casterArena(1 << 20, 6, GL_R32UI),
+    m_casterOrigins(4, GL_RG32F, m_casterArena.getCapacity() / BufferArena::pageSize * 8),
+    m_quadIndices(1 << 14)
 {
+    // the element array binding is part of the vertex array, so the
+    // indices are attached once and stay attached when an arena grows
+    m_arena.bind();
+    m_quadIndices.bind();
+    m_casterArena.bind();
+    m_quadIndices.bind();
+
+    m_pageOrigins.resize(m_arena.getCapacity() / BufferArena::pageSize * 2);
+    m_casterPageOrigins.resize(m_casterArena.getCapacity() / BufferArena::pageSize * 2);
     m_nchunks = nchunks;
+    m_cullStats[0] = m_cullStats[1] = {};
+    m_meshMode = MESH_PER_FACE;
+    m_casterMeshes = true;
+    m_meshGeneration = 0;
     m_chunks = new Chunk[nchunks * nchunks];
     if (!m_chunks)
         die("out of memory");
@@ -28,10 +55,144 @@ World::World(u32 nchunks) :
     m_sortedChunks = new ChunkDistPair[nchunks * nchunks];
     if (!m_sortedChunks)
         die("out of memory");
+
+    m_runningMeshes.resize(nchunks * nchunks);
+    m_cancelMeshes.resize(nchunks * nchunks);
+    m_generating = 0;
+
+    m_meshScratch.resize(m_pool.getThreadCount());
+    for (auto &s : m_meshScratch) {
+        s = new MeshScratch();
+        if (!s)
+            die("out of memory");
+    }
+}
+
+void World::_queueMeshing(Chunk *chunk)
+{
+    chunk->setState(Meshing);
+    ChunkMesh mesh;
+    mesh.chunk = chunk;
+    mesh.version = chunk->getVersion();
+    mesh.cancelled = false;
+    chunk->takeDirty(mesh.dirty);
+    MeshMode mode = m_meshMode;
+    bool casters = m_casterMeshes;
+    u32 index = (u32)(chunk - m_chunks);
+    m_pool.submit([this, mesh, mode, casters, index](u32 worker) mutable {
+        {
+            // a cancelled job hands its parts back without reading anything
+            std::lock_guard<std::mutex> lock(m_finishedMutex);
+            mesh.cancelled = m_cancelMeshes[index];
+            if (mesh.cancelled) {
+                m_finishedMeshes.push_back(std::move(mesh));
+                return;
+            }
+            m_runningMeshes[index] ++;
+        }
+
+        mesh.chunk->mesh(mode, casters, *m_meshScratch[worker], mesh);
+
+        {
+            std::lock_guard<std::mutex> lock(m_finishedMutex);
+            m_finishedMeshes.push_back(std::move(mesh));
+            m_runningMeshes[index] --;
+        }
+        m_jobDone.notify_all();
+    });
+}
+
+void World::_stopMeshing(i32 xmax, i32 xmin, i32 zmax, i32 zmin)
+{
+    std::vector<u32> chunks;
+    for (i32 x = xmin; x <= xmax && x < xmin + (i32)m_nchunks; x++)
+        for (i32 z = zmin; z <= zmax && z < zmin + (i32)m_nchunks; z++)
+            chunks.push_back(mod(x, m_nchunks) * m_nchunks + mod(z, m_nchunks));
+
+    std::unique_lock<std::mutex> lock(m_finishedMutex);
+    for (u32 i : chunks)
+        m_cancelMeshes[i] = 1;
+    m_jobDone.wait(lock, [this, &chunks] {
+        for (u32 i : chunks)
+            if (m_runningMeshes[i])
+                return false;
+        return true;
+    });
+}
+
+void World::_resumeMeshing()
+{
+    std::lock_guard<std::mutex> lock(m_finishedMutex);
+    std::fill(m_cancelMeshes.begin(), m_cancelMeshes.end(), 0);
+}
+
+void World::_uploadFinishedMeshes()
+{
+    std::vector<ChunkMesh> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_finishedMutex);
+        finished.swap(m_finishedMeshes);
+    }
+
+    // a chunk is drawn as one run of quads per kind, the indices have to
+    // reach the end of the longest
+    for (auto &mesh : finished) {
+        Chunk *c = mesh.chunk;
+        c->upload(mesh, m_arena, m_casterArena);
+        u32 most = std::max({c->getOpaqueCount(), c->getTransparentCount(), c->getCasterCount()});
+        m_quadIndices.reserve(most);
+    }
+    _updatePageOrigins(finished, false);
+    _updatePageOrigins(finished, true);
+    if (!finished.empty())
+        m_meshGeneration ++;
+}
+
+void World::_updatePageOrigins(const std::vector<ChunkMesh> &uploaded, bool casters)
+{
+    BufferArena &arena = casters ? m_casterArena : m_arena;
+    TextureBuffer &origins = casters ? m_casterOrigins : m_chunkOrigins;
+    std::vector<f32> &pageOrigins = casters ? m_casterPageOrigins : m_pageOrigins;
+
+    // a page is never shared between chunks, so the page of a record is
+    // enough to tell which chunk it belongs to
+    constexpr u32 pageSize = BufferArena::pageSize;
+    u32 pages = arena.getCapacity() / pageSize;
+    u32 lo = pages, hi = 0;
+    if (origins.getSize() != pages * 8) {
+        origins.resize(pages * 8);
+        pageOrigins.resize(pages * 2);
+        lo = 0, hi = pages;
+    }
+
+    for (auto &mesh : uploaded) {
+        const Chunk *c = mesh.chunk;
+        u32 offset = casters ? c->getCasterRangeOffset() : c->getRangeOffset();
+        u32 size = casters ? c->getCasterRangeSize() : c->getRangeSize();
+        u32 p0 = offset / pageSize;
+        u32 p1 = p0 + (size + pageSize - 1) / pageSize;
+        const Vec3 &o = c->getRenderOrigin();
+        for (u32 p = p0; p < p1; p ++) {
+            pageOrigins[p * 2 + 0] = o.x;
+            pageOrigins[p * 2 + 1] = o.z;
+        }
+        if (p0 < p1) {
+            lo = p0 < lo ? p0 : lo;
+            hi = p1 > hi ? p1 : hi;
+        }
+    }
+
+    if (lo < hi)
+        origins.subData(lo * 8, (hi - lo) * 8, &pageOrigins[lo * 2]);
 }
 
 void World::_loadNewChunks(i32 xmax, i32 xmin, i32 zmax, i32 zmin, i32 xinc, i32 zinc)
 {
+    // a new chunk takes the place of the old one in the grid, so both had
+    // their neighbours within a chunk of the range. only mesh jobs that
+    // read those have to be out of the way, the rest carry on
+    _stopMeshing(xmax + 1, xmin - 1, zmax + 1, zmin - 1);
+
     for (i32 x = xmin; x <= xmax; x++) {
         i32 xi = mod(x, m_nchunks);
         i32 bi = xi * m_nchunks;
@@ -42,6 +203,34 @@ void World::_loadNewChunks(i32 xmax, i32 xmin, i32 zmax, i32 zmin, i32 xinc, i32
         }
     }
 
+    for (i32 x = xmin; x <= xmax; x++) {
+        i32 xi = mod(x, m_nchunks);
+        i32 bi = xi * m_nchunks;
+        for (i32 z = zmin; z <= zmax; z++) {
+            i32 zi = mod(z, m_nchunks);
+            Chunk *self = &m_chunks[bi + zi];
+            {
+                std::lock_guard<std::mutex> lock(m_finishedMutex);
+                m_generating ++;
+            }
+            m_pool.submit([this, self, x, z](u32) {
+                self->generate(x, z, m_fbmc);
+                {
+                    std::lock_guard<std::mutex> lock(m_finishedMutex);
+                    m_generating --;
+                }
+                m_jobDone.notify_all();
+            });
+        }
+    }
+
+    // neighbours are only linked once every chunk is generated, linking
+    // is what hands them over to the mesher
+    {
+        std::unique_lock<std::mutex> lock(m_finishedMutex);
+        m_jobDone.wait(lock, [this] { return !m_generating; });
+    }
+
     i32 xn, zn;
     Chunk *p;
     for (i32 x = xmin; x <= xmax; x++) {
@@ -50,7 +239,6 @@ void World::_loadNewChunks(i32 xmax, i32 xmin, i32 zmax, i32 zmin, i32 xinc, i32
         for (i32 z = zmin; z <= zmax; z++) {
             i32 zi = mod(z, m_nchunks);
             Chunk &self = m_chunks[bi + zi];
-            self.generate(x, z, m_fbmc);
 
             if (x > xmin || xinc > 0) {
                 xn = mod(x - 1, m_nchunks), zn = zi;
@@ -101,6 +289,7 @@ void World::_loadNewChunks(i32 xmax, i32 xmin, i32 zmax, i32 zmin, i32 xinc, i32
             }
         }
     }
+    _resumeMeshing();
 }
 
 void World::generate(u64 seed, const Vec3 &pos)
@@ -123,9 +312,52 @@ void World::generate(u64 seed, const Vec3 &pos)
     _loadNewChunks(xmax, xmin, zmax, zmin, 0, 0);
     _sortChunks(pos);
 
+    // the chunks are sorted far to near and workers take their newest job
+    // first, so queueing them in order meshes the nearest first
     const i32 m = m_nchunks * m_nchunks;
     for (i32 i = 0; i < m; i++)
-        m_chunks[i].update();
+        _queueMeshing(m_sortedChunks[i].ptr);
+    m_pool.wait();
+    _uploadFinishedMeshes();
+}
+
+void World::setMeshMode(MeshMode mode)
+{
+    m_meshMode = mode;
+    const i32 m = m_nchunks * m_nchunks;
+    for (i32 i = 0; i < m; i++)
+        m_chunks[i].invalidate();
+}
+
+void World::setCasterMeshes(bool casters)
+{
+    m_casterMeshes = casters;
+    const i32 m = m_nchunks * m_nchunks;
+    for (i32 i = 0; i < m; i++)
+        m_chunks[i].invalidate();
+}
+
+MeshStats World::getMeshStats() const
+{
+    MeshStats r = {};
+    const i32 m = m_nchunks * m_nchunks;
+    for (i32 i = 0; i < m; i++) {
+        const MeshStats &s = m_chunks[i].getMeshStats();
+        r.quadCount       += s.quadCount;
+        r.faceQuadCount   += s.faceQuadCount;
+        r.casterQuadCount += s.casterQuadCount;
+        r.time          += s.time;
+    }
+    return r;
+}
+
+size_t World::getBlockMemory() const
+{
+    size_t r = 0;
+    const i32 m = m_nchunks * m_nchunks;
+    for (i32 i = 0; i < m; i++)
+        r += m_chunks[i].getBlocks().getMemoryUsage();
+    return r;
 }
 
 static bool operator > (const ChunkDistPair &a, const ChunkDistPair &b) {
@@ -146,6 +378,9 @@ void World::_sortChunks(const Vec3 &pos)
 
 World::~World()
 {
+    m_pool.wait();
+    for (auto s : m_meshScratch)
+        delete s;
     if (m_chunks)
         delete[] m_chunks;
 }
@@ -155,6 +390,8 @@ void World::update(const Vec3 &pos)
     i32 nxpos = (i32)floorf(pos.x / CHUNK_MAX_X);
     i32 nzpos = (i32)floorf(pos.z / CHUNK_MAX_Z);
 
+    _uploadFinishedMeshes();
+
     if (nxpos != m_xpos) {
         i32 xmin, xmax, zmin, zmax;
         i32 xinc = nxpos - m_xpos;
@@ -192,72 +429,139 @@ void World::update(const Vec3 &pos)
 
     _sortChunks(pos);
 
-    u32 c = 0;
+    // far to near, as in generate
     const i32 m = m_nchunks * m_nchunks;
-    for (i32 i = m - 1; i >= 0 && c < 4; i--) {
-        if (m_sortedChunks[i].ptr->getState() == NeedsUpdating) {
-            m_sortedChunks[i].ptr->update();
-            c ++;
-        }
-    }
+    for (i32 i = 0; i < m; i++)
+        if (m_sortedChunks[i].ptr->getState() == NeedsUpdating)
+            _queueMeshing(m_sortedChunks[i].ptr);
 }
 
-constexpr f32 hx = CHUNK_MAX_X / 2.0f;
-constexpr f32 hy = CHUNK_MAX_Y / 2.0f;
-constexpr f32 hz = CHUNK_MAX_Z / 2.0f;
-const Vec4 e[8] = {
-    {+hx, +hy, +hz, 0},
-    {+hx, +hy, -hz, 0},
-    {+hx, -hy, +hz, 0},
-    {+hx, -hy, -hz, 0},
-    {-hx, +hy, +hz, 0},
-    {-hx, +hy, -hz, 0},
-    {-hx, -hy, +hz, 0},
-    {-hx, -hy, -hz, 0},
-};
-
-void World::depthPass(const Shader &shader, const Mat4 &vp)
+void World::_cullChunks(const Mat4 &vp, u32 planes, bool sorted, CullStats &stats)
 {
     const i32 m = m_nchunks * m_nchunks;
+    m_culled.clear();
+    for (auto &b : m_boxes)
+        b.clear();
+
     for (i32 i = 0; i < m; i++) {
-        auto &r = m_chunks[i];
-        Vec4 c = Vec4(r.getCenter());
-        bool visible = false;
-        for (int i = 0; i < 8 && !visible; i ++) {
-            auto r = vp * (c + e[i]);
-            auto x = r.x / r.w;
-            auto y = r.y / r.w;
-            auto z = r.z / r.w;
-            visible = r.w > 0 && x <= 1 && x >= -1 && y <= 1 && y >= -1 && z <= 1 && z >= -1;
+        Chunk *c = sorted ? m_sortedChunks[i].ptr : &m_chunks[i];
+        if (!c->getOpaqueCount() && !c->getTransparentCount())
+            continue;
+
+        Vec3 center, extent;
+        c->getBounds(center, extent);
+        for (u32 k = 0; k < 3; k ++) {
+            m_boxes[k + 0].push_back(center[k]);
+            m_boxes[k + 3].push_back(extent[k]);
         }
+        m_culled.push_back(c);
+    }
 
-        if (visible)
-        {
-            r.renderPrep(shader);
-            r.renderOpaque();
+    BoxList boxes = {
+        {m_boxes[0].data(), m_boxes[1].data(), m_boxes[2].data()},
+        {m_boxes[3].data(), m_boxes[4].data(), m_boxes[5].data()},
+        (u32)m_culled.size(),
+    };
+    m_visible.resize(boxes.count);
+    stats.drawn = cullBoxes(Frustum(vp, planes), boxes, m_visible.data());
+    stats.culled = boxes.count - stats.drawn;
+
+    u32 n = 0;
+    for (u32 i = 0; i < boxes.count; i ++)
+        if (m_visible[i])
+            m_culled[n++] = m_culled[i];
+    m_culled.resize(n);
+}
+
+// every draw starts at the first of the shared quad indices, firsts are
+// the base vertices added to them. the vertex shader finds the record of
+// a vertex by dividing its index by QUAD_VERTS
+static void multiDraw(const std::vector<i32> &firsts, const std::vector<i32> &counts)
+{
+    static std::vector<const void *> offsets;
+    if (firsts.empty())
+        return;
+    offsets.resize(firsts.size(), nullptr);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(),
+                                  (i32)firsts.size(), firsts.data());
+}
+
+static inline i32 quadIndexCount(u32 records)
+{
+    return records * QUAD_INDICES;
+}
+
+static inline i32 quadBaseVertex(u32 record)
+{
+    return record * QUAD_VERTS;
+}
+
+void World::depthPass(const Shader &shader, const Mat4 &vp)
+{
+    // the depth shader clamps what is in front of the near plane onto it
+    // instead of clipping, so casters behind the light still count
+    _cullChunks(vp, PLANES_ALL & ~PLANE_NEAR, false, m_cullStats[0]);
+
+    // until the chunks are meshed again after caster meshes were switched
+    // on some have none, they cast no shadow for that long
+    bool casters = m_casterMeshes;
+    m_drawFirsts[0].clear();
+    m_drawCounts[0].clear();
+    for (Chunk *c : m_culled) {
+        u32 count = casters ? c->getCasterCount() : c->getOpaqueCount();
+        if (count) {
+            m_drawFirsts[0].push_back(quadBaseVertex(casters ? c->getCasterFirstRecord() : c->getFirstRecord()));
+            m_drawCounts[0].push_back(quadIndexCount(count));
         }
     }
+
+    TextureBuffer &origins = casters ? m_casterOrigins : m_chunkOrigins;
+    BufferArena &arena = casters ? m_casterArena : m_arena;
+    shader.uniform("chunkOrigins", (i32)origins.getTextureUnit());
+    shader.uniform("records", (i32)arena.getTextureUnit());
+    origins.bind();
+    arena.bind();
+    multiDraw(m_drawFirsts[0], m_drawCounts[0]);
 }
 
 void World::renderPass(const Shader &shader, const Mat4 &vp)
 {
-    m_textureArray.bind();
-    const i32 m = m_nchunks * m_nchunks;
-    for (i32 i = 0; i < m; i++) {
-        auto ptr = m_sortedChunks[i].ptr;
-
-        Vec4 c = Vec4(ptr->getCenter());
-        bool visible = false;
-        for (i32 j = 0; j < 8 && !visible; j ++) {
-            auto r = vp * (c + e[j]);
-            auto x = r.x / r.w;
-            visible = r.w > 0 && x <= 1 && x >= -1;
-        }
+    // the block shader writes a logarithmic depth that clips far beyond
+    // the far plane of the projection, so that plane is left out
+    _cullChunks(vp, PLANES_ALL & ~PLANE_FAR, true, m_cullStats[1]);
 
-        if (visible) {
-            ptr->renderPrep(shader);
-            ptr->renderOpaque();
-            ptr->renderTransparent();
+    for (u32 k = 0; k < 2; k ++) {
+        m_drawFirsts[k].clear();
+        m_drawCounts[k].clear();
+    }
+
+    // chunks are sorted back to front. opaque geometry goes front to back
+    // so the depth test throws away hidden fragments before they are shaded,
+    // the transparent geometry follows all of it back to front, in the
+    // order it has to be blended in
+    for (i32 i = (i32)m_culled.size() - 1; i >= 0; i--) {
+        Chunk *c = m_culled[i];
+        if (c->getOpaqueCount()) {
+            m_drawFirsts[0].push_back(quadBaseVertex(c->getFirstRecord()));
+            m_drawCounts[0].push_back(quadIndexCount(c->getOpaqueCount()));
+        }
+    }
+    for (Chunk *c : m_culled) {
+        if (c->getTransparentCount()) {
+            m_drawFirsts[1].push_back(quadBaseVertex(c->getFirstRecord() + c->getOpaqueCount()));
+            m_drawCounts[1].push_back(quadIndexCount(c->getTransparentCount()));
         }
     }
+
+    shader.uniform("chunkOrigins", (i32)m_chunkOrigins.getTextureUnit());
+    shader.uniform("records", (i32)m_arena.getTextureUnit());
+    m_textureArray.bind();
+    m_chunkOrigins.bind();
+    m_arena.bind();
+    multiDraw(m_drawFirsts[0], m_drawCounts[0]);
+    if (!m_drawFirsts[1].empty()) {
+        glEnable(GL_BLEND);
+        multiDraw(m_drawFirsts[1], m_drawCounts[1]);
+        glDisable(GL_BLEND);
+    }
 }
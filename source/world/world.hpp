@@ -4,31 +4,116 @@
 #include "utility/common.hpp"
 #include "utility/noise.hpp"
 #include "rendering/textureArray.hpp"
+#include "rendering/bufferArena.hpp"
+#include "rendering/textureBuffer.hpp"
+#include "rendering/quadIndexBuffer.hpp"
+#include "utility/threadPool.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <vector>
 
 class Shader;
 class Chunk;
+struct MeshStats;
+struct MeshScratch;
+struct ChunkMesh;
+enum MeshMode : int;
 struct ChunkDistPair;
 union Mat4;
 
+// chunks with a mesh that the last pass drew or culled by frustum
+struct CullStats {
+    u32 drawn;
+    u32 culled;
+};
+
 class World {
 public:
     World(u32 nchunks = 8);
     ~World();
 
+    static void queueAssets();
+
     void generate(u64 seed, const Vec3 &pos);
     void update(const Vec3 &pos);
     void depthPass (const Shader &shader, const Mat4 &vp);
     void renderPass(const Shader &shader, const Mat4 &vp);
+    void setMeshMode(MeshMode mode);
+    MeshMode getMeshMode() const { return m_meshMode; }
+
+    // with caster meshes the depth pass draws a low detail mesh made for
+    // it, which the depth shader has to be built for, instead of the
+    // opaque mesh
+    void setCasterMeshes(bool casters);
+    bool getCasterMeshes() const { return m_casterMeshes; }
+    MeshStats getMeshStats() const;
+    size_t getBlockMemory() const;
+    const CullStats &getDepthCullStats () const { return m_cullStats[0]; }
+    const CullStats &getRenderCullStats() const { return m_cullStats[1]; }
     const TextureArray &getTextureArray() { return m_textureArray; }
+    const BufferArena &getArena() const { return m_arena; }
+    const QuadIndexBuffer &getQuadIndices() const { return m_quadIndices; }
+
+    // changes whenever a chunk mesh that is drawn changes
+    u32 getMeshGeneration() const { return m_meshGeneration; }
 private:
     i32 m_xpos, m_zpos;
     i32 m_xoff, m_zoff;
     Chunk *m_chunks;
     ChunkDistPair *m_sortedChunks;
     u32 m_nchunks;
+    MeshMode m_meshMode;
+    bool m_casterMeshes;
+    u32 m_meshGeneration;
     FBMConfig m_fbmc;
     TextureArray m_textureArray;
+    BufferArena m_arena;           // face records of every chunk
+    TextureBuffer m_chunkOrigins;  // origin of the chunk owning each page of the arena
+    std::vector<f32> m_pageOrigins;
+    BufferArena m_casterArena;     // shadow caster records of every chunk
+    TextureBuffer m_casterOrigins; // same as m_chunkOrigins for the caster arena
+    std::vector<f32> m_casterPageOrigins;
+    QuadIndexBuffer m_quadIndices; // shared by both arenas
+    // base vertices and index counts, opaque and transparent
+    std::vector<i32> m_drawFirsts[2], m_drawCounts[2];
+    std::vector<f32> m_boxes[6]; // centers and extents of the chunks to cull
+    std::vector<Chunk *> m_culled;
+    std::vector<u8> m_visible;
+    CullStats m_cullStats[2]; // depth and render pass
 
+    ThreadPool m_pool;
+    std::vector<MeshScratch *> m_meshScratch;
+    std::vector<ChunkMesh> m_finishedMeshes;
+    // guards the finished meshes and the job counts below
+    std::mutex m_finishedMutex;
+    std::condition_variable m_jobDone;
+    std::vector<u32> m_runningMeshes; // mesh jobs running on each chunk
+    std::vector<u8> m_cancelMeshes;   // mesh jobs of each chunk that have to skip
+    u32 m_generating;                 // generate jobs not yet finished
+
+    void _queueMeshing(Chunk *chunk);
+    void _uploadFinishedMeshes();
     void _loadNewChunks(i32 xmax, i32 xmin, i32 zmax, i32 zmin, i32 xinc, i32 zinc);
     void _sortChunks(const Vec3 &pos);
+
+    /// <summary>
+    /// Cancels the mesh jobs of the chunks in the given range of the grid
+    /// that have not started and waits for the ones that have, until
+    /// _resumeMeshing. The range wraps around the grid
+    /// </summary>
+    void _stopMeshing(i32 xmax, i32 xmin, i32 zmax, i32 zmin);
+    void _resumeMeshing();
+
+    /// <summary>
+    /// Points the pages of the uploaded chunks at their origins, the shaders
+    /// look the origin up from the index of the record. casters picks the
+    /// caster arena
+    /// </summary>
+    void _updatePageOrigins(const std::vector<ChunkMesh> &uploaded, bool casters);
+
+    /// <summary>
+    /// Fills m_culled with the chunks that have a mesh and touch the frustum
+    /// of vp made of the given planes, back to front when sorted is set
+    /// </summary>
+    void _cullChunks(const Mat4 &vp, u32 planes, bool sorted, CullStats &stats);
 };
@@ -0,0 +1,101 @@
+// writes blocks one at a time into a chunk whose sections start out with a
+// single type and gain a new type every so often, so a section goes through
+// every index width from none to 8 bits. get, decodeColumn and compress are
+// held to a dense grid written alongside, and the width is checked after
+// every new type
+//   cd build && ./release/block-check [seed]
+#include "world/blockStorage.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static u32 rng;
+static u32 randomInt(u32 n)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng % n;
+}
+
+// the width a section needs for a number of types
+static u32 bitsFor(u32 types)
+{
+    return types == 1 ? 0 : types <= 2 ? 1 : types <= 4 ? 2 : types <= 16 ? 4 : 8;
+}
+
+static bool checkAll(const BlockStorage &s, const BlockGrid &grid, const char *what)
+{
+    u8 column[SECTION_COUNT * SECTION_HEIGHT];
+    for (u32 x = 0; x < CHUNK_MAX_X; x ++) {
+        for (u32 z = 0; z < CHUNK_MAX_Z; z ++) {
+            s.decodeColumn(x, z, column);
+            for (u32 y = 0; y < CHUNK_MAX_Y; y ++) {
+                if (s.get(x, y, z) != grid[x][z][y] || column[y] != grid[x][z][y]) {
+                    printf("%s: block (%u, %u, %u) is %u, decoded %u, should be %u\n", what,
+                           x, y, z, s.get(x, y, z), column[y], grid[x][z][y]);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// section k starts out all base, then gets random blocks of ever more types
+// until it holds 40 of them
+static bool runSection(BlockStorage &s, BlockGrid &grid, u32 k, u8 base)
+{
+    u32 y0 = k * SECTION_HEIGHT;
+    u32 y1 = y0 + SECTION_HEIGHT < CHUNK_MAX_Y ? y0 + SECTION_HEIGHT : CHUNK_MAX_Y;
+    u32 types = 1;
+    for (u32 n = 0; n < 4000; n ++) {
+        // a new type every 100 writes
+        u8 t = (u8)(base + (n % 100 == 0 && types < 40 ? types ++ : randomInt(types)));
+        u32 x = randomInt(CHUNK_MAX_X), z = randomInt(CHUNK_MAX_Z);
+        u32 y = y0 + randomInt(y1 - y0);
+        s.set(x, y, z, t);
+        grid[x][z][y] = t;
+
+        if (s.get(x, y, z) != t) {
+            printf("section %u: block (%u, %u, %u) reads %u after writing %u\n", k, x, y, z, s.get(x, y, z), t);
+            return false;
+        }
+
+        // every type ever written stays in the palette, so the width only
+        // depends on how many there were
+        u32 bits = s.getSection(k).bits;
+        if (bits != bitsFor(types)) {
+            printf("section %u: %u types in %u bits, should be %u\n", k, types, bits, bitsFor(types));
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    rng = argc > 1 ? (u32)strtoul(argv[1], nullptr, 0) : 0x9e3779b9;
+    if (!rng)
+        rng = 1;
+
+    static BlockGrid grid;
+    memset(grid, 7, sizeof(grid));
+    BlockStorage s(7);
+
+    bool ok = true;
+    for (u32 k = 0; k < SECTION_COUNT && ok; k ++) {
+        ok = runSection(s, grid, k, 7);
+        ok = ok && checkAll(s, grid, "set");
+    }
+
+    // compress has to come back to the same blocks, with the narrowest width
+    if (ok) {
+        BlockStorage c;
+        c.compress(grid);
+        ok = checkAll(c, grid, "compress");
+    }
+
+    printf("%s\n", ok ? "ok" : "failed");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+// runs two overlapping mesh jobs of one chunk through the upload
+// bookkeeping, finishing them in both orders, and a job cancelled before
+// it ran. fails when parts that still need meshing are left on a chunk the
+// world would not queue again
+//   cd build && ./release/chunk-check
+#include "world/chunk.hpp"
+#include <stdio.h>
+
+// what World::_queueMeshing does before handing the job to a worker
+static void queue(Chunk &c, ChunkMesh &mesh)
+{
+    c.setState(Meshing);
+    mesh.chunk = &c;
+    mesh.version = c.getVersion();
+    mesh.cancelled = false;
+    c.takeDirty(mesh.dirty);
+}
+
+// the chunk is queued again with the parts it had
+static bool runCancelled()
+{
+    Chunk c;
+    c.setState(Ready);
+    c.invalidate();
+
+    ChunkMesh mesh;
+    queue(c, mesh);
+    mesh.cancelled = true;
+    c.acceptMesh(mesh);
+
+    u16 dirty[MESH_REGIONS];
+    c.takeDirty(dirty);
+    bool back = true;
+    for (u32 r = 0; r < MESH_REGIONS; r ++)
+        back = back && dirty[r] == 0xffff;
+
+    bool ok = back && c.getState() == NeedsUpdating;
+    printf("cancelled mesh: %s\n", ok ? "ok" : "dirty parts lost");
+    return ok;
+}
+
+static bool run(bool staleFirst)
+{
+    Chunk c;
+    c.setState(Ready);
+    c.invalidate();
+
+    ChunkMesh older, newer;
+    queue(c, older);
+    c.invalidate();
+    queue(c, newer);
+
+    if (staleFirst) {
+        c.acceptMesh(older);
+        c.acceptMesh(newer);
+    } else {
+        c.acceptMesh(newer);
+        c.acceptMesh(older);
+    }
+
+    u16 dirty[MESH_REGIONS];
+    c.takeDirty(dirty);
+    bool left = false;
+    for (u32 r = 0; r < MESH_REGIONS; r ++)
+        left = left || dirty[r];
+
+    bool ok = !left || c.getState() == NeedsUpdating;
+    printf("%s mesh first: %s\n", staleFirst ? "stale" : "newer", ok ? "ok" : "dirty parts lost");
+    return ok;
+}
+
+int main()
+{
+    bool ok = run(true);
+    ok = run(false) && ok;
+    ok = runCancelled() && ok;
+    return ok ? 0 : 1;
+}
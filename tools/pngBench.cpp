@@ -0,0 +1,55 @@
+// decodes PNG files from memory a number of times and prints the decode
+// throughput, by default over the skybox images
+//   cd build && ./release/png-bench [runs] [files...]
+#include "utility/png.hpp"
+#include <stdio.h>
+#include <chrono>
+
+static const char *defaultFiles[] = {
+    "../resources/skybox/right.png",
+    "../resources/skybox/left.png",
+    "../resources/skybox/top.png",
+    "../resources/skybox/bottom.png",
+    "../resources/skybox/front.png",
+    "../resources/skybox/back.png",
+};
+
+int main(int argc, char **argv)
+{
+    u32 runs = argc > 1 ? (u32)atoi(argv[1]) : 5;
+    const char **files = argc > 2 ? (const char **)argv + 2 : defaultFiles;
+    u32 nfiles = argc > 2 ? argc - 2 : sizeof(defaultFiles) / sizeof(*defaultFiles);
+    if (!runs)
+        die("usage: %s [runs] [files...]", argv[0]);
+
+    f64 totalIn = 0, totalOut = 0, totalTime = 0;
+    for (u32 i = 0; i < nfiles; i ++) {
+        size_t size;
+        u8 *buffer = readEntireFile(files[i], &size);
+        if (!buffer)
+            die("failed to open %s", files[i]);
+
+        f64 best = 1e30;
+        u32 w = 0, h = 0;
+        for (u32 r = 0; r < runs; r ++) {
+            auto t0 = std::chrono::high_resolution_clock::now();
+            u8 *pixels = loadPNGFromMemory(buffer, size, &w, &h);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            if (!pixels)
+                die("%s: %s", files[i], getPNGError());
+            free(pixels);
+            f64 t = std::chrono::duration<f64>(t1 - t0).count();
+            best = t < best ? t : best;
+        }
+        free(buffer);
+
+        f64 out = 4.0 * w * h;
+        printf("%-32s %5ux%-5u %7.2f ms %7.1f MB/s compressed %7.1f MB/s decoded\n",
+               files[i], w, h, best * 1e3, size / best / 1e6, out / best / 1e6);
+        totalIn += size, totalOut += out, totalTime += best;
+    }
+
+    printf("total %.2f ms, %.1f MB/s compressed, %.1f MB/s decoded\n",
+           totalTime * 1e3, totalIn / totalTime / 1e6, totalOut / totalTime / 1e6);
+    return 0;
+}
@@ -0,0 +1,85 @@
+// runs random rows through every PNG unfilter kernel the cpu has and fails
+// on the first byte where a SIMD kernel disagrees with the scalar one. every
+// filter type, 3 and 4 byte pixels, widths 1 to 70 and a large one, each
+// from the start of the row and from halfway along it
+//   cd build && ./release/png-check [seed]
+#include "utility/png.hpp"
+#include <stdio.h>
+#include <vector>
+
+static const char *filterNames[] = {"none", "sub", "up", "average", "paeth"};
+static const char *pathNames[] = {"scalar", "sse2", "ssse3"};
+
+static u32 rng;
+static u8 randomByte()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (u8)(rng >> 24);
+}
+
+static void fill(std::vector<u8> &v)
+{
+    for (auto &b : v)
+        b = randomByte();
+}
+
+// false and a message on the first mismatch
+static bool checkRow(u32 width, u32 bpp, u32 type, u32 start)
+{
+    // sized exactly so an address sanitizer catches reads past the row
+    std::vector<u8> prev(width * 4), filt(width * bpp), head(width * 4);
+    fill(prev), fill(filt), fill(head);
+
+    std::vector<u8> expected = head;
+    unfilterPNGRow(PNG_UNFILTER_SCALAR, expected.data(), prev.data(), filt.data(), start, width, bpp, type);
+
+    for (u32 p = PNG_UNFILTER_SSE2; p <= PNG_UNFILTER_SSSE3; p ++) {
+        std::vector<u8> out = head;
+        if (!unfilterPNGRow((PNGUnfilterPath)p, out.data(), prev.data(), filt.data(), start, width, bpp, type))
+            continue;
+        for (u32 i = 0; i < width * 4; i ++) {
+            if (out[i] == expected[i])
+                continue;
+            printf("%s: filter %s, bpp %u, width %u, start %u: byte %u is %u, scalar gives %u\n",
+                   pathNames[p], filterNames[type], bpp, width, start, i, out[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    rng = argc > 1 ? (u32)atoi(argv[1]) : 0x9e3779b9u;
+    if (!rng)
+        die("usage: %s [nonzero seed]", argv[0]);
+
+    u32 widths[71];
+    for (u32 i = 0; i < 70; i ++)
+        widths[i] = i + 1;
+    widths[70] = 4099;
+
+    u32 rows = 0, failed = 0;
+    for (u32 type = 0; type < 5; type ++) {
+        for (u32 bpp = 3; bpp <= 4; bpp ++) {
+            for (u32 w : widths) {
+                for (u32 half = 0; half < 2; half ++) {
+                    u32 start = half ? w / 2 : 0;
+                    if (half && !start)
+                        continue;
+                    rows ++;
+                    failed += !checkRow(w, bpp, type, start);
+                }
+            }
+        }
+    }
+
+    u8 scratch[4] = {};
+    printf("%u rows checked against scalar with%s%s, %u failed\n", rows,
+           unfilterPNGRow(PNG_UNFILTER_SSE2 , scratch, scratch, scratch, 0, 0, 4, 0) ? " sse2"  : "",
+           unfilterPNGRow(PNG_UNFILTER_SSSE3, scratch, scratch, scratch, 0, 0, 4, 0) ? " ssse3" : "",
+           failed);
+    return failed ? 1 : 0;
+}